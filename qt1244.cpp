@@ -20,10 +20,209 @@
   Download datasheet from this link,
   http://ww1.microchip.com/downloads/en/devicedoc/Atmel-9631-AT42-QT1244_Datasheet.pdf
 *******************************************************************************************************/
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
 #include "qt1244.h"
 
+#if defined (QT1244_ARBITER)
+#include "qt1244_arbiter.h"
+#endif
+
+#if defined (STM32F4)
+
+// For MCUs STM32F4xx
+void qt1244ReadBlock(uint8_t devAddr, uint8_t regAddr, uint8_t* data, uint16_t len) {
+#if defined (QT1244_I2C_BURST)
+  qt1244ReadBurst(devAddr, regAddr, data, len);
+#else
+  for (uint16_t i = 0; i < len; i++) {
+    data[i] = qt1244Read(devAddr, regAddr + i);
+  }
+#endif
+}
+
+void qt1244WriteBlock(uint8_t devAddr, uint8_t regAddr, const uint8_t* data, uint16_t len) {
+#if defined (QT1244_I2C_BURST)
+  qt1244WriteBurst(devAddr, regAddr, data, len);
+#else
+  for (uint16_t i = 0; i < len; i++) {
+    qt1244Write(devAddr, regAddr + i, data[i]);
+  }
+#endif
+}
+
+/*
+	A chip ID of 0x00 or 0xFF is an empty bus, not a QT1244.
+*/
+static bool chipValid(uint8_t chipId) {
+#if defined (QT1244_CHIP_ID)
+  return chipId == QT1244_CHIP_ID;
+#else
+  return (chipId != 0x00) && (chipId != 0xFF);
+#endif
+}
+
+/*
+	Fill table[0] - table[3] for QT1244_ADDR_1 - QT1244_ADDR_4 and return
+	the number of devices present. All addresses are ACK-probed first, then
+	each chip that answered is identified.
+*/
+uint8_t qt1244Probe(QT1244Device* table) {
+  static const uint8_t addr[4] = { QT1244_ADDR_1, QT1244_ADDR_2, QT1244_ADDR_3, QT1244_ADDR_4 };
+  uint8_t found = 0;
+
+  I2C_HandleTypeDef hi2c = qt1244Init();
+  bool ready = (hi2c.State == HAL_I2C_STATE_READY);
+
+  for (uint8_t i = 0; i < 4; i++) {
+    table[i].addr = addr[i];
+    table[i].chipId = 0;
+    table[i].version = 0;
+#if defined (QT1244_I2C_PROBE)
+    table[i].present = ready && qt1244Ack(addr[i] << 1);
+#else
+    table[i].present = ready;
+#endif
+  }
+
+  for (uint8_t i = 0; i < 4; i++) {
+    if (table[i].present) {
+      uint8_t id[2];
+      qt1244ReadBlock(addr[i] << 1, CHIP_ID_ADDR, id, 2);
+      table[i].chipId = id[0];
+      table[i].version = id[1];
+      table[i].present = chipValid(id[0]);
+      found += table[i].present;
+    }
+  }
+
+  return found;
+}
+
+/*
+	All register access of the driver goes through these. With an arbiter
+	attached, reads that end below COMMAND_ADDR (status, detect and key data)
+	are queued at ARBITER_PRIORITY_KEYS, everything else, a memory map dump
+	included, at ARBITER_PRIORITY_CONFIG. Writes from COMMAND_ADDR are never
+	split into chunks.
+*/
+void QT1244::readRegs(uint8_t regAddr, uint8_t* data, uint16_t len) {
+#if defined (QT1244_ARBITER)
+  if (BUS) {
+    ArbiterTransfer t;
+
+    t.client = CLIENT;
+    t.priority = (regAddr + len <= COMMAND_ADDR) ? ARBITER_PRIORITY_KEYS : ARBITER_PRIORITY_CONFIG;
+    t.devAddr = DEVADDR;
+    t.regAddr = regAddr;
+    t.data = data;
+    t.len = len;
+    t.write = false;
+    t.whole = false;
+    t.xfer = 0;
+    t.done = 0;
+    BUS->run(&t);
+    return;
+  }
+#endif
+  qt1244ReadBlock(DEVADDR, regAddr, data, len);
+}
+
+void QT1244::writeRegs(uint8_t regAddr, const uint8_t* data, uint16_t len) {
+#if defined (QT1244_ARBITER)
+  if (BUS) {
+    ArbiterTransfer t;
+
+    t.client = CLIENT;
+    t.priority = ARBITER_PRIORITY_CONFIG;
+    t.devAddr = DEVADDR;
+    t.regAddr = regAddr;
+    t.data = (uint8_t*)data;
+    t.len = len;
+    t.write = true;
+    t.whole = (regAddr == COMMAND_ADDR);
+    t.xfer = 0;
+    t.done = 0;
+    BUS->run(&t);
+    return;
+  }
+#endif
+  qt1244WriteBlock(DEVADDR, regAddr, data, len);
+}
+
+uint8_t QT1244::readReg(uint8_t regAddr) {
+#if defined (QT1244_ARBITER)
+  if (BUS) {
+    uint8_t data;
+
+    readRegs(regAddr, &data, 1);
+    return data;
+  }
+#endif
+  return qt1244Read(DEVADDR, regAddr);
+}
+
+void QT1244::writeReg(uint8_t regAddr, uint8_t data) {
+#if defined (QT1244_ARBITER)
+  if (BUS) {
+    writeRegs(regAddr, &data, 1);
+    return;
+  }
+#endif
+  qt1244Write(DEVADDR, regAddr, data);
+}
+
+#endif
+
 
 QT1244::QT1244() {
+#if defined (QT1244_FEATURE_PROFILES)
+  SHADOWVALID = false;
+  BATCHOPEN = false;
+  BATCHCMD = false;
+  memset(SHADOW, 0, SETUPS_SIZE);
+  memset(BATCHDIRTY, 0, BATCH_DIRTY_SIZE);
+#endif
+
+#if defined (QT1244_ARBITER)
+  BUS = 0;
+#endif
+
+#if defined (QT1244_SUPERVISOR)
+  HEALSTATE = 0;
+  HEALKEY = 0;
+  HEALLEVEL = 0;
+  HEALCOUNT = 0;
+  HEALSTART = 0;
+  HEALWINDOW = 0;
+  HEALFAILING = 0;
+  for (uint8_t k = 0; k < QT1244_KEYS; k++) {
+    HEALTRIES[k] = 0;
+  }
+#endif
+
+#if defined (QT1244_SYNC)
+  uint8_t image[SETUPS_SIZE];
+
+  defaultSetups(image);
+  CYCLEANCHOR = 0;
+  CYCLEREAD = 0;
+  CYCLEKEYS = 0;
+  CYCLEEDGE = false;
+  cycleSetups(image);
+#endif
+
+#if defined (QT1244_POWER)
+  POWERWAKES = 0;
+  POWEROVERRUNS = 0;
+  POWERLATMAX = 0;
+  POWERLATSUM = 0;
+  POWERSLEEP = 0;
+  POWERACTIVE = 0;
+  POWERLAST = 0;
+#endif
+
 #if defined (STM32F4)
 
   // For MCUs STM32F4xx
@@ -46,24 +245,28 @@ bool QT1244::begin(uint8_t devAddr) {
 #if defined (STM32F4)
 
   // For MCUs STM32F4xx
-  if (devAddr == 57) {
-    DEVADDR = QT1244_ADDR_1 << 1;
-  }
-  else if (devAddr == 7) {
-    DEVADDR = QT1244_ADDR_2 << 1;
+  if ((devAddr != QT1244_ADDR_1) && (devAddr != QT1244_ADDR_2) &&
+      (devAddr != QT1244_ADDR_3) && (devAddr != QT1244_ADDR_4)) {
+    return false;
   }
-  else if (devAddr == 17) {
-    DEVADDR = QT1244_ADDR_3 << 1;
+  DEVADDR = devAddr << 1;
+	
+  I2C_HandleTypeDef hi2c = qt1244Init();
+  if (hi2c.State != HAL_I2C_STATE_READY) {
+    return false;
   }
-  else if (devAddr == 117) {
-    DEVADDR = QT1244_ADDR_4 << 1;
+
+#if defined (QT1244_I2C_PROBE)
+  if (!qt1244Ack(DEVADDR)) {
+    return false;
   }
-  else {
-    // TODO: Error Handling
+#endif
+
+  uint8_t id[2];
+  readRegs(CHIP_ID_ADDR, id, 2);
+  if (!chipValid(id[0])) {
+    return false;
   }
-	
-  I2C_HandleTypeDef hi2c = qt1244Init();
-  while (hi2c.State != HAL_I2C_STATE_READY);
 
 #else
 
@@ -78,34 +281,310 @@ bool QT1244::setups(void) {
 #if defined (STM32F4)
 
   // For MCUs STM32F4xx
-  qt1244Write(DEVADDR, COMMAND_ADDR, SETUPS_WRITE_ENABLE);
-
-  qt1244Write(DEVADDR, NTHR_PTHR_NDRIFT_BL_ADDR, ((BL_VALUE << 6) | (NDRIFT_VALUE << 3) | NTHR_PTHR_VALUE));
-  qt1244Write(DEVADDR, NDIL_FDIL_AKS_WAKE_ADDR, ((WAKE_VALUE << 7) | (AKS_VALUE << 6) | (FDIL_VALUE << 3) | NDIL_VALUE));
-  qt1244Write(DEVADDR, CFO_1_ADDR, CFO_1_VALUE);
-  qt1244Write(DEVADDR, CFO_2_ADDR, CFO_2_VALUE);
-  qt1244Write(DEVADDR, NRD_ADDR, NRD_VALUE);
-  qt1244Write(DEVADDR, SLEEP_MSYNC_NHYST_DEBUG_ADDR, ((DEBUG_VALUE << 6) | (NHYST_VALUE << 4) | (MSYNC_VALUE << 3) | SLEEP_VALUE));
-  qt1244Write(DEVADDR, AWAKE_ADDR, AWAKE_VALUE);
-  qt1244Write(DEVADDR, DHT_ADDR, DHT_VALUE);
-  qt1244Write(DEVADDR, PDRIFT_SSYNC_ADDR, ((SSYNC_VALUE << 3) | PDRIFT_VALUE));
-  qt1244Write(DEVADDR, LSLlsb_ADDR, LSLlsb_VALUE);
-  qt1244Write(DEVADDR, LSLmsb_KGTT_ADDR, ((KGTT_VALUE << 4) | LSLmsb_VALUE));
-  qt1244Write(DEVADDR, DWELL_RIB_THRM_FHM_ADDR, ((FHM_VALUE << 6) | (THRM_VALUE << 4) | (RIB_VALUE << 3) | DWELL_VALUE));
-  qt1244Write(DEVADDR, FREQ0_ADDR, FREQ0_VALUE);
-  qt1244Write(DEVADDR, FREQ1_ADDR, FREQ1_VALUE);
-  qt1244Write(DEVADDR, FREQ2_ADDR, FREQ2_VALUE);
-  qt1244Write(DEVADDR, NSTHR_NIL_ADDR, ((NIL_VALUE << 4) | NSTHR_VALUE));
+#if defined (QT1244_VERIFY)
+  uint8_t image[SETUPS_SIZE];
+
+  defaultSetups(image);
+  return setups(image);
+#else
+#if defined (QT1244_FEATURE_PROFILES)
+  SHADOWVALID = false;
+#endif
+
+  writeReg(COMMAND_ADDR, SETUPS_WRITE_ENABLE);
+
+  writeReg(NTHR_PTHR_NDRIFT_BL_ADDR, (BL_FIELD::put(BL_VALUE) | NDRIFT_FIELD::put(NDRIFT_VALUE) | NTHR_FIELD::put(NTHR_PTHR_VALUE)));
+  writeReg(NDIL_FDIL_AKS_WAKE_ADDR, (WAKE_FIELD::put(WAKE_VALUE) | AKS_FIELD::put(AKS_VALUE) | FDIL_FIELD::put(FDIL_VALUE) | NDIL_FIELD::put(NDIL_VALUE)));
+  writeReg(CFO_1_ADDR, CFO_1_VALUE);
+  writeReg(CFO_2_ADDR, CFO_2_VALUE);
+  writeReg(NRD_ADDR, NRD_VALUE);
+  writeReg(SLEEP_MSYNC_NHYST_DEBUG_ADDR, (DEBUG_FIELD::put(DEBUG_VALUE) | NHYST_FIELD::put(NHYST_VALUE) | MSYNC_FIELD::put(MSYNC_VALUE) | SLEEP_FIELD::put(SLEEP_VALUE)));
+  writeReg(AWAKE_ADDR, AWAKE_VALUE);
+  writeReg(DHT_ADDR, DHT_VALUE);
+  writeReg(PDRIFT_SSYNC_ADDR, (SSYNC_FIELD::put(SSYNC_VALUE) | PDRIFT_FIELD::put(PDRIFT_VALUE)));
+  writeReg(LSLlsb_ADDR, LSLlsb_VALUE);
+  writeReg(LSLmsb_KGTT_ADDR, (KGTT_FIELD::put(KGTT_VALUE) | LSLmsb_FIELD::put(LSLmsb_VALUE)));
+  writeReg(DWELL_RIB_THRM_FHM_ADDR, (FHM_FIELD::put(FHM_VALUE) | THRM_FIELD::put(THRM_VALUE) | RIB_FIELD::put(RIB_VALUE) | DWELL_FIELD::put(DWELL_VALUE)));
+  writeReg(FREQ0_ADDR, FREQ0_VALUE);
+  writeReg(FREQ1_ADDR, FREQ1_VALUE);
+  writeReg(FREQ2_ADDR, FREQ2_VALUE);
+  writeReg(NSTHR_NIL_ADDR, (NIL_FIELD::put(NIL_VALUE) | NSTHR_FIELD::put(NSTHR_VALUE)));
+
+#if defined (QT1244_SYNC)
+  uint8_t image[SETUPS_SIZE];
+
+  defaultSetups(image);
+  cycleSetups(image);
+#endif
+#endif
+
+#else
+
+  // Others MCUs
+
+#endif
+
+  return true;
+}
+
+#if defined (QT1244_ARBITER)
+
+void QT1244::arbiter(QT1244Arbiter* bus, uint8_t client) {
+  BUS = bus;
+  CLIENT = client;
+}
+
+#endif
+
+#if defined (QT1244_FEATURE_PROFILES)
+
+bool QT1244::setups(const uint8_t* image) {
+#if defined (STM32F4)
+
+  // For MCUs STM32F4xx
+  // Write-enable and the whole setups block in a single I2C sequence
+  writeRuns(image, 0);
+
+  memcpy(SHADOW, image, SETUPS_SIZE);
+#if defined (QT1244_VERIFY)
+  SHADOWVALID = verifySetups(image);
+  return SHADOWVALID;
+#else
+  SHADOWVALID = true;
+#endif
+
+#else
+
+  // Others MCUs
+
+#endif
+
+  return true;
+}
+
+/*
+	Make image (a SETUPS_SIZE block, e.g. QT1244Profile::image) the active
+	setups, writing only what differs from the shadow copy, then check the
+	HCRC VERIFY_SETTLE_US later. Without a valid shadow the whole block is
+	written.
+*/
+bool QT1244::switchProfile(const uint8_t* image) {
+#if defined (STM32F4)
+
+  // For MCUs STM32F4xx
+  if (SHADOWVALID && (memcmp(SHADOW, image, SETUPS_SIZE) == 0)) {
+    return true;
+  }
+
+  writeRuns(image, SHADOWVALID ? SHADOW : 0);
+
+  memcpy(SHADOW, image, SETUPS_SIZE);
+#if defined (QT1244_VERIFY)
+  SHADOWVALID = verifySetups(image);
+#else
+  Delay_us(VERIFY_SETTLE_US);
+  SHADOWVALID = !(readReg(STATUS_ADDR) & STATUS_HCRC_ERROR);
+#endif
+
+  return SHADOWVALID;
+
+#else
+
+  // Others MCUs
+  return false;
+
+#endif
+}
+
+/*
+	Forget the shadow copy after the setups were changed without this
+	object, e.g. by asyncSetups() or another host, so the next upload is
+	written in full and the next set<Field>() reads the block back first.
+*/
+void QT1244::invalidateShadow(void) {
+  SHADOWVALID = false;
+}
+
+/*
+	Change the bits selected by mask in count consecutive setups bytes from
+	regAddr, used by set<Field>(). The shadow copy is loaded with one burst
+	read if it is not valid yet; then only the changed bytes and the HCRC
+	are written, as writeRuns() groups them.
+*/
+bool QT1244::setField(uint8_t regAddr, uint8_t count, uint8_t mask, uint8_t bits) {
+#if defined (STM32F4)
+
+  // For MCUs STM32F4xx
+  bool open = BATCHOPEN;
+
+  if (!open) {
+    batchBegin();
+  }
+
+  for (uint8_t i = regAddr - SETUPS_ADDR; count > 0; i++, count--) {
+    if ((SHADOW[i] & mask) != bits) {
+      SHADOW[i] = (SHADOW[i] & ~mask) | bits;
+      BATCHDIRTY[i >> 3] |= 1 << (i & 7);
+    }
+  }
+
+  return open ? true : batchCommit();
 
 #else
 
   // Others MCUs
+  return false;
+
+#endif
+}
+
+#if defined (STM32F4)
+
+#if defined (QT1244_VERIFY)
+
+/*
+	Confirm an upload with the HCRC error bit; on a mismatch, read the
+	setups back and rewrite only the corrupted runs. A readback equal to
+	the image means the image's own HCRC is wrong: nothing to repair.
+*/
+bool QT1244::verifySetups(const uint8_t* image) {
+  uint8_t current[SETUPS_SIZE];
+
+  for (uint8_t tries = 0; ; tries++) {
+    Delay_us(VERIFY_SETTLE_US);
+    if (!(readReg(STATUS_ADDR) & STATUS_HCRC_ERROR)) {
+      return true;
+    }
+    if (tries == VERIFY_RETRIES) {
+      return false;
+    }
+
+    readRegs(SETUPS_ADDR, current, SETUPS_SIZE);
+    if (memcmp(current, image, SETUPS_SIZE) == 0) {
+      return false;
+    }
+    writeRuns(image, current);
+  }
+}
+
+#endif
+
+void QT1244::batchBegin(void) {
+  if (!SHADOWVALID) {
+    readRegs(SETUPS_ADDR, SHADOW, SETUPS_SIZE);
+    SHADOWVALID = true;
+  }
+
+  memset(BATCHDIRTY, 0, BATCH_DIRTY_SIZE);
+  BATCHCMD = false;
+  BATCHOPEN = true;
+}
+
+void QT1244::batchCommand(uint8_t command) {
+  BATCHCOMMAND = command;
+  BATCHCMD = true;
+}
+
+bool QT1244::batchCommit(void) {
+  bool dirty = false;
+
+  if (!BATCHOPEN) {
+    return false;
+  }
+  BATCHOPEN = false;
+
+  for (uint8_t i = 0; i < BATCH_DIRTY_SIZE; i++) {
+    dirty |= (BATCHDIRTY[i] != 0);
+  }
+
+  if (dirty) {
+    const uint8_t crc = HCRClsb_ADDR - SETUPS_ADDR;
+    uint8_t lsb = SHADOW[crc];
+    uint8_t msb = SHADOW[crc + 1];
 
+    setupsCRC(SHADOW);
+    if ((SHADOW[crc] != lsb) || (SHADOW[crc + 1] != msb)) {
+      BATCHDIRTY[crc >> 3] |= 1 << (crc & 7);
+      BATCHDIRTY[(crc + 1) >> 3] |= 1 << ((crc + 1) & 7);
+    }
+
+    writeRuns(SHADOW, 0, BATCHDIRTY);
+
+#if defined (QT1244_VERIFY)
+    SHADOWVALID = verifySetups(SHADOW);
+    if (!SHADOWVALID) {
+      return false;
+    }
 #endif
+  }
+
+  if (BATCHCMD) {
+    writeReg(COMMAND_ADDR, BATCHCOMMAND);
+    BATCHCMD = false;
+  }
 
   return true;
 }
 
+/*
+	Write image from COMMAND_ADDR on, preceded by write-enable. Only the
+	bytes that differ from current, or are flagged in the dirty bitmap,
+	are written; with neither, the whole block. Runs are split where more
+	than SETUPS_RUN_GAP unchanged bytes separate two changes, or more than
+	SETUPS_ENABLE_GAP the write-enable and the first change; never with
+	QT1244_STRICT_WRITE_ENABLE or an arbiter attached. Returns the number
+	of transactions.
+*/
+uint8_t QT1244::writeRuns(const uint8_t* image, const uint8_t* current, const uint8_t* dirty) {
+  uint8_t block[1 + SETUPS_SIZE];
+  uint8_t transactions = 0;
+  int16_t start = -1, end = 0;
+
+  block[0] = SETUPS_WRITE_ENABLE;
+  memcpy(&block[1], image, SETUPS_SIZE);
+
+  for (int16_t i = 0; i < 1 + SETUPS_SIZE; i++) {
+    uint8_t k = i - 1;
+
+    if ((i == 0) || (!current && !dirty) ||
+        (current && (image[k] != current[k])) ||
+        (dirty && (dirty[k >> 3] & (1 << (k & 7))))) {
+#if defined (QT1244_STRICT_WRITE_ENABLE)
+      bool split = false;
+#else
+      bool split = (start >= 0) && (i - end > ((end == 1) ? SETUPS_ENABLE_GAP : SETUPS_RUN_GAP));
+#endif
+#if defined (QT1244_ARBITER)
+      // A read by another client between two runs would re-enable the protection
+      split = split && !BUS;
+#endif
+
+      if (split) {
+        writeRegs(COMMAND_ADDR + start, &block[start], end - start);
+        transactions++;
+        start = -1;
+      }
+      if (start < 0) {
+        start = i;
+      }
+      end = i + 1;
+    }
+  }
+
+  writeRegs(COMMAND_ADDR + start, &block[start], end - start);
+  transactions++;
+
+#if defined (QT1244_SYNC)
+  cycleSetups(image);
+#endif
+
+  return transactions;
+}
+
+#endif
+
+#endif
+
 #if defined (STM32F4)
 
 // For MCUs STM32F4xx
@@ -126,7 +605,7 @@ void QT1244::softwareReset(void) {
 #if defined (STM32F4)
 	
   // For MCUs STM32F4xx
-	qt1244Write(DEVADDR, COMMAND_ADDR, FORCE_RESET);
+	writeReg(COMMAND_ADDR, FORCE_RESET);
 	Delay_us(10);
 
 #else
@@ -149,11 +628,13 @@ uint8_t QT1244::changeStatus(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin) {
 #endif
 }
 
+#if defined (QT1244_FEATURE_CALIBRATION)
+
 bool QT1244::calibrateKeyAll(void) {
 #if defined (STM32F4)
 
   // For MCUs STM32F4xx
-  qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_ALL);
+  writeReg(COMMAND_ADDR, CALIBRATE_KEY_ALL);
 
 #else
 
@@ -164,85 +645,19 @@ bool QT1244::calibrateKeyAll(void) {
   return true;
 }
 
+/*
+	Recalibrate key 0 - 23 in its own timeslot; the other keys keep running.
+	Returns false for a key out of range.
+*/
 bool QT1244::calibrateKey(uint8_t key) {
+  if (key > CALIBRATE_KEY_23) {
+    return false;
+  }
+
 #if defined (STM32F4)
 
   // For MCUs STM32F4xx
-  if (key == 0) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_0);
-  }
-  else if (key == 1) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_1);
-  }
-  else if (key == 2) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_2);
-  }
-  else if (key == 3) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_3);
-  }
-  else if (key == 4) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_4);
-  }
-  else if (key == 5) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_5);
-  }
-  else if (key == 6) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_6);
-  }
-  else if (key == 7) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_7);
-  }
-  else if (key == 8) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_8);
-  }
-  else if (key == 9) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_9);
-  }
-  else if (key == 10) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_10);
-  }
-  else if (key == 11) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_11);
-  }
-  else if (key == 12) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_12);
-  }
-  else if (key == 13) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_13);
-  }
-  else if (key == 14) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_14);
-  }
-  else if (key == 15) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_15);
-  }
-  else if (key == 16) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_16);
-  }
-  else if (key == 17) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_17);
-  }
-  else if (key == 18) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_18);
-  }
-  else if (key == 19) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_19);
-  }
-  else if (key == 20) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_20);
-  }
-  else if (key == 21) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_21);
-  }
-  else if (key == 22) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_22);
-  }
-  else if (key == 23) {
-    qt1244Write(DEVADDR, COMMAND_ADDR, CALIBRATE_KEY_23);
-  }
-  else {
-    // TODO: Error Handling
-  }
+  writeReg(COMMAND_ADDR, key);
 
 #else
 
@@ -253,13 +668,15 @@ bool QT1244::calibrateKey(uint8_t key) {
   return true;
 }
 
+#endif
+
 uint8_t QT1244::scanKey(void) {
 #if defined (STM32F4)
 	
 	// For MCUs STM32F4xx
 	uint8_t key, keyMask;
 
-	key = qt1244Read(DEVADDR, KEY_0TO7_ADDR);
+	key = readReg(KEY_0TO7_ADDR);
 
 	keyMask = 0x01;
 
@@ -272,7 +689,7 @@ uint8_t QT1244::scanKey(void) {
 		}
 	}
 
-	key = qt1244Read(DEVADDR, KEY_8TO15_ADDR);
+	key = readReg(KEY_8TO15_ADDR);
 
 	keyMask = 0x01;
 
@@ -285,7 +702,7 @@ uint8_t QT1244::scanKey(void) {
 		}
 	}
 
-	key = qt1244Read(DEVADDR, KEY_16TO23_ADDR);
+	key = readReg(KEY_16TO23_ADDR);
 
 	keyMask = 0x01;
 
@@ -389,22 +806,423 @@ uint8_t QT1244::scanKey(void) {
 	return 0;
 }
 
-bool QT1244::HCRCStatus(void) {
+/*
+	Detect status of all 24 keys from one burst of addresses 6 - 8,
+	bit k set while key k is in detect.
+*/
+uint32_t QT1244::snapshot(void) {
 #if defined (STM32F4)
 
   // For MCUs STM32F4xx
-  uint8_t x = qt1244Read(DEVADDR, STATUS_ADDR);
-  x &= 0x01;
-  if (x == 0x01) {
-    return true;
-  }
-  else {
-    return false;
-  }
-
-#else
+  uint8_t keys[3];
+  uint32_t mask;
 
-  // Others MCUs
+  readRegs(KEY_0TO7_ADDR, keys, sizeof(keys));
+  mask = ((uint32_t)keys[2] << 16) | ((uint32_t)keys[1] << 8) | keys[0];
+
+#if defined (QT1244_STATS)
+  STATS.edges(mask, HAL_GetTick());
+#endif
+
+  return mask;
+
+#else
+
+  // Others MCUs
+  return 0;
+
+#endif
+}
+
+/*
+	data: QT1244_KEYS * KEY_DATA_SIZE bytes, the key data sets of all keys
+	from one burst.
+*/
+void QT1244::readKeyData(uint8_t* data) {
+#if defined (STM32F4)
+
+  // For MCUs STM32F4xx
+  readRegs(KEY_DATA_ADDR, data, QT1244_KEYS * KEY_DATA_SIZE);
+
+#if defined (QT1244_STATS)
+  uint32_t failed = 0;
+
+  for (uint8_t k = 0; k < QT1244_KEYS; k++) {
+    if (data[k * KEY_DATA_SIZE + KEY_DATA_STATUS] & KEY_STATUS_CAL_FAIL) {
+      failed |= 1UL << k;
+    }
+  }
+  STATS.calibration(failed);
+#endif
+
+#else
+
+  // Others MCUs
+
+#endif
+}
+
+#if defined (QT1244_STATS)
+
+/*
+	Consistent copy of the usage statistics while another task keeps
+	scanning. Returns false when the copy met an update in progress every
+	time (see STATS_READ_TRIES): yield and call again.
+*/
+bool QT1244::stats(QT1244StatsData* copy) {
+  return STATS.read(copy);
+}
+
+#endif
+
+#if defined (QT1244_SUPERVISOR)
+
+#define HEAL_IDLE     0
+#define HEAL_KEY      1	// calibrateKey(HEALKEY) running
+#define HEAL_ALL      2	// calibrateKeyAll() or softwareReset() running
+
+/*
+	now: millisecond timestamp. Returns the keys currently failing
+	calibration, as of the last key data read.
+*/
+uint32_t QT1244::supervise(uint32_t now) {
+  uint8_t data[QT1244_KEYS * KEY_DATA_SIZE];
+  uint32_t failing = 0;
+  bool exhausted;
+
+  // Wait for the running recalibration to finish
+  if (HEALSTATE != HEAL_IDLE) {
+    uint32_t elapsed = now - HEALSTART;
+    bool busy;
+
+    if (elapsed < SUPERVISOR_SETTLE_MS) {
+      return HEALFAILING;
+    }
+    if (HEALSTATE == HEAL_KEY) {
+      busy = readReg(KEY_DATA_ADDR + HEALKEY * KEY_DATA_SIZE + KEY_DATA_STATUS) & KEY_STATUS_CALIBRATING;
+    }
+    else {
+      busy = readReg(STATUS_ADDR) & STATUS_CALIBRATING;
+    }
+    if (busy && (elapsed < SUPERVISOR_TIMEOUT_MS)) {
+      return HEALFAILING;
+    }
+    HEALSTATE = HEAL_IDLE;
+  }
+
+  readKeyData(data);
+
+  for (uint8_t k = 0; k < QT1244_KEYS; k++) {
+    if (data[k * KEY_DATA_SIZE + KEY_DATA_STATUS] & KEY_STATUS_CAL_FAIL) {
+      failing |= 1UL << k;
+    }
+    else {
+      HEALTRIES[k] = 0;
+    }
+  }
+  HEALFAILING = failing;
+
+  if (failing == 0) {
+    HEALLEVEL = 0;
+    return 0;
+  }
+
+  // A quiet window gives back one escalation level and one retry per key
+  if (now - HEALWINDOW >= SUPERVISOR_WINDOW_MS) {
+    HEALWINDOW = now;
+    HEALCOUNT = 0;
+    if (HEALLEVEL > 0) {
+      HEALLEVEL--;
+    }
+    for (uint8_t k = 0; k < QT1244_KEYS; k++) {
+      if (HEALTRIES[k] > 0) {
+        HEALTRIES[k]--;
+      }
+    }
+  }
+
+  exhausted = (HEALCOUNT >= SUPERVISOR_BUDGET);
+  for (uint8_t k = 0; k < QT1244_KEYS; k++) {
+    if ((failing & (1UL << k)) && (HEALTRIES[k] >= SUPERVISOR_RETRIES)) {
+      exhausted = true;
+    }
+  }
+
+  if (exhausted && (HEALLEVEL < 2)) {
+    if (HEALLEVEL == 0) {
+      calibrateKeyAll();
+    }
+    else {
+      softwareReset();
+    }
+    HEALLEVEL++;
+    HEALSTATE = HEAL_ALL;
+    HEALSTART = now;
+    HEALWINDOW = now;
+    HEALCOUNT = 0;
+    for (uint8_t k = 0; k < QT1244_KEYS; k++) {
+      HEALTRIES[k] = 0;
+    }
+    return failing;
+  }
+
+  if (exhausted) {
+    // Out of escalations: only keys still within their retries are tried
+    for (uint8_t k = 0; k < QT1244_KEYS; k++) {
+      if (HEALTRIES[k] >= SUPERVISOR_RETRIES) {
+        failing &= ~(1UL << k);
+      }
+    }
+    if (failing == 0) {
+      return HEALFAILING;
+    }
+  }
+
+  // Next failing key after the last one, round robin
+  for (uint8_t i = 1; i <= QT1244_KEYS; i++) {
+    uint8_t k = (HEALKEY + i) % QT1244_KEYS;
+
+    if (failing & (1UL << k)) {
+      calibrateKey(k);
+      HEALTRIES[k]++;
+      HEALCOUNT++;
+      HEALKEY = k;
+      HEALSTATE = HEAL_KEY;
+      HEALSTART = now;
+      break;
+    }
+  }
+
+  return HEALFAILING;
+}
+
+#endif
+
+#if defined (QT1244_SYNC)
+
+/*
+	Nominal acquisition cycle of image (a SETUPS_SIZE block) in
+	microseconds.
+*/
+uint32_t cycleModel(const uint8_t* image) {
+  static const uint8_t blPulses[4] = QT1244_BL_PULSES;
+  uint8_t dwell = DWELL_FIELD::get(image[DWELL_RIB_THRM_FHM_ADDR - SETUPS_ADDR]);
+  uint32_t spacing = SYNC_PULSE_NS + dwell * SYNC_DWELL_NS;
+  uint32_t pulses = 0;
+  uint32_t period;
+
+  for (uint8_t k = 0; k < QT1244_KEYS; k++) {
+    pulses += blPulses[BL_FIELD::get(image[NTHR_PTHR_NDRIFT_BL_ADDR - SETUPS_ADDR + k])];
+  }
+
+  period = SYNC_CYCLE_US + QT1244_KEYS * SYNC_KEY_US + pulses * spacing / 1000;
+
+  if (MSYNC_FIELD::get(image[SLEEP_MSYNC_NHYST_DEBUG_ADDR - SETUPS_ADDR])) {
+    period = (period + SYNC_MAINS_US - 1) / SYNC_MAINS_US * SYNC_MAINS_US;
+  }
+
+  return period;
+}
+
+// New setups: restart the estimate from their model
+void QT1244::cycleSetups(const uint8_t* image) {
+  uint32_t model = cycleModel(image);
+
+  __disable_irq();
+  CYCLEMODEL = model;
+  CYCLEPERIOD = model;
+  __enable_irq();
+}
+
+/*
+	CHANGE falling edge at now (microseconds), from the EXTI handler. An
+	interval within SYNC_TOLERANCE_PCT of the model spans one cycle and
+	moves the estimate by 1/8. Any other interval spans several cycles, or
+	is a glitch, and is not learnt from; the tolerance is checked against
+	the model, so the estimate cannot drift onto a multiple of the period.
+*/
+void QT1244::cycleEdge(uint32_t now) {
+  uint32_t interval = now - CYCLEANCHOR;
+  uint32_t model = CYCLEMODEL;
+  uint32_t tolerance = model * SYNC_TOLERANCE_PCT / 100;
+
+  if ((CYCLEANCHOR != 0) && (interval + tolerance >= model) && (interval <= model + tolerance)) {
+    int32_t error = (int32_t)interval - (int32_t)CYCLEPERIOD;
+
+    CYCLEPERIOD += error / 8;
+  }
+
+  CYCLEANCHOR = now;
+  CYCLEEDGE = true;
+}
+
+/*
+	Read the detect status if a cycle has completed since the last read.
+	Returns false, without touching the bus, while the current cycle is
+	still running.
+*/
+bool QT1244::cycleRead(uint32_t now, uint32_t* keys) {
+  uint32_t anchor, period;
+  bool edge;
+
+  // One consistent copy of what cycleEdge() writes
+  __disable_irq();
+  anchor = CYCLEANCHOR;
+  period = CYCLEPERIOD;
+  edge = CYCLEEDGE;
+  CYCLEEDGE = false;
+  __enable_irq();
+
+  if (edge) {
+    // A fresh edge: the status of the cycle that just ended is due now
+    CYCLEREAD = 0;
+#if defined (QT1244_STATS)
+    STATS.latency(now - anchor);
+#endif
+  }
+  else if (cycleDue(now, anchor, period) != 0) {
+    return false;
+  }
+  else {
+    CYCLEREAD = (now - anchor - SYNC_GUARD_US) / period;
+  }
+
+  *keys = snapshot();
+
+  // Keys changed without an edge (CHANGE not wired): re-anchor on this read
+  if ((*keys != CYCLEKEYS) && (CYCLEREAD != 0)) {
+    __disable_irq();
+    if (!CYCLEEDGE) {
+      CYCLEANCHOR = now - SYNC_GUARD_US;
+      CYCLEREAD = 0;
+    }
+    __enable_irq();
+  }
+  CYCLEKEYS = *keys;
+
+  return true;
+}
+
+uint32_t QT1244::cycleDue(uint32_t now, uint32_t anchor, uint32_t period) {
+  uint32_t due = anchor + (CYCLEREAD + 1) * period + SYNC_GUARD_US;
+
+  if ((int32_t)(now - due) >= 0) {
+    return 0;
+  }
+
+  return due - now;
+}
+
+/*
+	Microseconds until the next cycleRead() will read, 0 when it is due.
+*/
+uint32_t QT1244::cycleWait(uint32_t now) {
+  uint32_t anchor, period;
+  bool edge;
+
+  __disable_irq();
+  anchor = CYCLEANCHOR;
+  period = CYCLEPERIOD;
+  edge = CYCLEEDGE;
+  __enable_irq();
+
+  return edge ? 0 : cycleDue(now, anchor, period);
+}
+
+uint32_t QT1244::cyclePeriod(void) {
+  return CYCLEPERIOD;
+}
+
+#endif
+
+#if defined (QT1244_POWER)
+
+/*
+	Sleep until CHANGE (active low) falls, then return the detect status.
+	CHANGE is sampled with interrupts masked so an edge between the check
+	and WFI still ends the STOP. They are enabled again as soon as the
+	clock is back, before the read: the I2C transport relies on the HAL
+	tick for its timeouts.
+*/
+uint32_t QT1244::powerIdle(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin) {
+  uint32_t now;
+  uint32_t keys;
+
+  __disable_irq();
+  now = qt1244PowerClock();
+  if (POWERLAST != 0) {
+    POWERACTIVE += now - POWERLAST;
+  }
+
+  if (HAL_GPIO_ReadPin(GPIOx, GPIO_Pin) == GPIO_PIN_SET) {
+    HAL_SuspendTick();
+    HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
+
+    uint32_t wake = qt1244PowerClock();
+    POWERSLEEP += wake - now;
+    now = wake;
+
+    qt1244PowerResume();
+    HAL_ResumeTick();
+    __enable_irq();
+
+    keys = snapshot();
+
+    uint32_t latency = qt1244PowerClock() - now;
+    POWERWAKES++;
+    POWERLATSUM += latency;
+    if (latency > POWERLATMAX) {
+      POWERLATMAX = latency;
+    }
+    if (latency > POWER_LATENCY_US) {
+      POWEROVERRUNS++;
+    }
+#if defined (QT1244_STATS)
+    STATS.latency(latency);
+#endif
+  }
+  else {
+    __enable_irq();
+    keys = snapshot();
+  }
+
+  POWERLAST = now;
+
+  return keys;
+}
+
+void QT1244::powerStats(QT1244PowerStats* copy) {
+  copy->wakes = POWERWAKES;
+  copy->overruns = POWEROVERRUNS;
+  copy->latencyMax = POWERLATMAX;
+  copy->latencyAvg = POWERWAKES ? (uint32_t)(POWERLATSUM / POWERWAKES) : 0;
+  copy->sleepUs = POWERSLEEP;
+  copy->activeUs = POWERACTIVE;
+
+  uint64_t total = POWERSLEEP + POWERACTIVE;
+  copy->dutyPermille = total ? (uint16_t)(POWERACTIVE * 1000 / total) : 0;
+}
+
+#endif
+
+#if defined (QT1244_FEATURE_STATUS)
+
+bool QT1244::HCRCStatus(void) {
+#if defined (STM32F4)
+
+  // For MCUs STM32F4xx
+  uint8_t x = readReg(STATUS_ADDR);
+  x &= 0x01;
+  if (x == 0x01) {
+    return true;
+  }
+  else {
+    return false;
+  }
+
+#else
+
+  // Others MCUs
 
 #endif
 }
@@ -413,7 +1231,7 @@ bool QT1244::mainSyncErrorStatus(void) {
 #if defined (STM32F4)
 
   // For MCUs STM32F4xx
-  uint8_t x = qt1244Read(DEVADDR, STATUS_ADDR);
+  uint8_t x = readReg(STATUS_ADDR);
   x &= 0x02;
   if (x == 0x02) {
     return true;
@@ -433,7 +1251,7 @@ bool QT1244::keyCalibrationStatus(void) {
 #if defined (STM32F4)
 
   // For MCUs STM32F4xx
-  uint8_t x = qt1244Read(DEVADDR, STATUS_ADDR);
+  uint8_t x = readReg(STATUS_ADDR);
   x &= 0x04;
   if (x == 0x04) {
     return true;
@@ -453,7 +1271,7 @@ bool QT1244::LSLStatus(void) {
 #if defined (STM32F4)
 
   // For MCUs STM32F4xx
-  uint8_t x = qt1244Read(DEVADDR, STATUS_ADDR);
+  uint8_t x = readReg(STATUS_ADDR);
   x &= 0x08;
   if (x == 0x08) {
     return true;
@@ -473,7 +1291,7 @@ bool QT1244::FMEAStatus(void) {
 #if defined (STM32F4)
 
   // For MCUs STM32F4xx
-  uint8_t x = qt1244Read(DEVADDR, STATUS_ADDR);
+  uint8_t x = readReg(STATUS_ADDR);
   x &= 0x10;
   if (x == 0x10) {
     return true;
@@ -489,41 +1307,188 @@ bool QT1244::FMEAStatus(void) {
 #endif
 }
 
-void QT1244::debug(uint8_t no) {
+#endif
+
+#if defined (QT1244_FEATURE_DEBUG)
+
+/*
+	high: mask of the bits above bit 7 in the byte after addr, for a field
+	split over two registers (the 11-bit LSL); 0 for the others.
+*/
+typedef struct {
+  const char* name;
+  uint8_t addr;
+  uint8_t mask;
+  uint8_t shift;
+  uint8_t count;
+  uint8_t high;
+} FieldInfo;
+
+#define FIELD_INFO(name, Field)   { name, Field::addr, Field::mask, Field::shift, Field::count, 0 }
+#define FIELD_INFO_WIDE(name, Low, High)   { name, Low::addr, Low::mask, Low::shift, Low::count, High::mask }
+
+static_assert((LSLmsb_FIELD::addr == LSLlsb_FIELD::addr + 1) && (LSLmsb_FIELD::shift == 0) && (LSLlsb_FIELD::count == 1),
+              "LSL must be the low byte followed by the high bits");
+
+// Report end when it does not fit the buffer
+#define DEBUG_CUT   "...\n"
+
+static const FieldInfo fieldInfo[] = {
+  FIELD_INFO("NTHR", NTHR_FIELD), FIELD_INFO("NDRIFT", NDRIFT_FIELD), FIELD_INFO("BL", BL_FIELD),
+  FIELD_INFO("NDIL", NDIL_FIELD), FIELD_INFO("FDIL", FDIL_FIELD), FIELD_INFO("AKS", AKS_FIELD),
+  FIELD_INFO("WAKE", WAKE_FIELD), FIELD_INFO("CFO_1", CFO_1_FIELD), FIELD_INFO("CFO_2", CFO_2_FIELD),
+  FIELD_INFO("NRD", NRD_FIELD), FIELD_INFO("SLEEP", SLEEP_FIELD), FIELD_INFO("MSYNC", MSYNC_FIELD),
+  FIELD_INFO("NHYST", NHYST_FIELD), FIELD_INFO("DEBUG", DEBUG_FIELD), FIELD_INFO("AWAKE", AWAKE_FIELD),
+  FIELD_INFO("DHT", DHT_FIELD), FIELD_INFO("PDRIFT", PDRIFT_FIELD), FIELD_INFO("SSYNC", SSYNC_FIELD),
+  FIELD_INFO_WIDE("LSL", LSLlsb_FIELD, LSLmsb_FIELD), FIELD_INFO("KGTT", KGTT_FIELD),
+  FIELD_INFO("DWELL", DWELL_FIELD), FIELD_INFO("RIB", RIB_FIELD), FIELD_INFO("THRM", THRM_FIELD),
+  FIELD_INFO("FHM", FHM_FIELD), FIELD_INFO("FREQ0", FREQ0_FIELD), FIELD_INFO("FREQ1", FREQ1_FIELD),
+  FIELD_INFO("FREQ2", FREQ2_FIELD), FIELD_INFO("NSTHR", NSTHR_FIELD), FIELD_INFO("NIL", NIL_FIELD)
+};
+
+static uint16_t fieldValue(const uint8_t* setups, const FieldInfo* info, uint8_t key) {
+  uint16_t value = (setups[info->addr - SETUPS_ADDR + key] & info->mask) >> info->shift;
+
+  if (info->high) {
+    value |= (setups[info->addr - SETUPS_ADDR + 1] & info->high) << 8;
+  }
+
+  return value;
+}
+
+static bool fieldUniform(const uint8_t* setups, const FieldInfo* info) {
+  for (uint8_t k = 1; k < info->count; k++) {
+    if (fieldValue(setups, info, k) != fieldValue(setups, info, 0)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+typedef struct {
+  char* text;
+  uint16_t size;
+  uint16_t len;
+  uint16_t mark;		// End of the last item DEBUG_CUT still fits after
+  bool cut;
+} Report;
+
+/*
+	One item of the report, whole or not at all. The first item that does
+	not fit ends the report: it goes back to the last item end with room
+	for DEBUG_CUT and puts DEBUG_CUT there.
+*/
+static void append(Report* r, const char* format, ...) {
+  uint16_t room = r->size - r->len;
+  va_list args;
+  int n;
+
+  if (r->cut) {
+    return;
+  }
+
+  va_start(args, format);
+  n = vsnprintf(&r->text[r->len], room, format, args);
+  va_end(args);
+
+  if ((n >= 0) && (n < room)) {
+    r->len += n;
+    if (r->len + sizeof(DEBUG_CUT) <= r->size) {
+      r->mark = r->len;
+    }
+    return;
+  }
+
+  r->cut = true;
+  r->len = r->mark;
+  if (r->len + sizeof(DEBUG_CUT) <= r->size) {
+    memcpy(&r->text[r->len], DEBUG_CUT, sizeof(DEBUG_CUT));
+    r->len += sizeof(DEBUG_CUT) - 1;
+  }
+  else {
+    r->text[r->len] = 0;
+  }
+}
+
+/*
+	Read the whole memory map (addresses 0 - 250) in one burst, decode every
+	setups field and compare the setups with the expected block (the shadow
+	copy, or defaultSetups() without one). The text report goes to report,
+	at most size bytes including the terminating 0:
+
+	  id=2A ver=15 status=00 keys=000004 hcrc=ok
+	  diff 146:1E/1B 249:04/7C       address:actual/expected, hex
+	  NTHR=3 NDRIFT=4 BL=0 ... LSL=100 ... NIL=3
+	  CFO_1=0,0,1,0,...              per-key fields that are not uniform
+
+	A report that does not fit ends with "...\n" after the last whole item
+	(value, diff entry or line end) that left room for it.
+
+	Returns the report length.
+*/
+uint16_t QT1244::debug(char* report, uint16_t size) {
+  Report r = { report, size, 0, 0, false };
+  const char* separator = "";
+
+  if (size == 0) {
+    return 0;
+  }
+  report[0] = 0;
+
 #if defined (STM32F4)
 
   // For MCUs STM32F4xx
-  if (no == 0) {
-//    uint8_t NTHR_PTHR = NTHR_PTHR_VALUE;
-//    uint8_t NDRIFT = NDRIFT_VALUE << 3;
-//    uint8_t BL = BL_VALUE << 6;
-//    uint8_t NDIL = NDIL_VALUE;
-//    uint8_t FDIL = FDIL_VALUE << 3;
-//    uint8_t AKS = AKS_VALUE << 6;
-//    uint8_t WAKE = WAKE_VALUE << 7;
-//    uint8_t CFO_1 = CFO_1_VALUE;
-//    uint8_t CFO_2 = CFO_2_VALUE;
-//    uint8_t NRD = NRD_VALUE;
-//    uint8_t SLEEP = SLEEP_VALUE;
-//    uint8_t MSYNC = MSYNC_VALUE << 3;
-//    uint8_t NHYST = NHYST_VALUE << 4;
-//    uint8_t DEBUG = DEBUG_VALUE << 6;
-//    uint8_t AWAKE = AWAKE_VALUE;
-//    uint8_t DHT = DHT_VALUE;
-//    uint8_t PDRIFT = PDRIFT_VALUE;
-//    uint8_t SSYNC = SSYNC_VALUE << 3;
-//    uint8_t LSL_LSB = LSLlsb_VALUE;
-//    uint8_t LSL_MSB = LSLmsb_VALUE;
-//    uint8_t KGTT = KGTT_VALUE << 4;
-//    uint8_t DWELL = DWELL_VALUE;
-//    uint8_t RIB = RIB_VALUE << 3;
-//    uint8_t THRM = THRM_VALUE << 4;
-//    uint8_t FHM = FHM_VALUE << 6;
-//    uint8_t FREQ0 = FREQ0_VALUE;
-//    uint8_t FREQ1 = FREQ1_VALUE;
-//    uint8_t FREQ2 = FREQ2_VALUE;
-//    uint8_t NSTHR = NSTHR_VALUE;
-//    uint8_t NIL = NIL_VALUE << 4;
+  uint8_t map[MEMORY_MAP_SIZE];
+  uint8_t expected[SETUPS_SIZE];
+  const uint8_t* setups = &map[SETUPS_ADDR];
+
+  readRegs(0, map, sizeof(map));
+
+#if defined (QT1244_FEATURE_PROFILES)
+  if (SHADOWVALID) {
+    memcpy(expected, SHADOW, SETUPS_SIZE);
+  }
+  else
+#endif
+  {
+    defaultSetups(expected);
+  }
+
+  append(&r, "id=%02X ver=%02X status=%02X keys=%02X%02X%02X hcrc=%s\n",
+         map[CHIP_ID_ADDR], map[VERSION_ADDR], map[STATUS_ADDR],
+         map[KEY_16TO23_ADDR], map[KEY_8TO15_ADDR], map[KEY_0TO7_ADDR],
+         (map[STATUS_ADDR] & STATUS_HCRC_ERROR) ? "bad" : "ok");
+
+  append(&r, "diff");
+  for (uint8_t i = 0; i < SETUPS_SIZE; i++) {
+    if (setups[i] != expected[i]) {
+      append(&r, " %u:%02X/%02X", SETUPS_ADDR + i, setups[i], expected[i]);
+    }
+  }
+  append(&r, "\n");
+
+  // Single fields, and per-key fields with the same value on every key
+  for (uint8_t f = 0; f < sizeof(fieldInfo) / sizeof(fieldInfo[0]); f++) {
+    if (fieldUniform(setups, &fieldInfo[f])) {
+      append(&r, "%s%s=%u", separator, fieldInfo[f].name, fieldValue(setups, &fieldInfo[f], 0));
+      separator = " ";
+    }
+  }
+  append(&r, "\n");
+
+  // Per-key fields that differ between keys
+  for (uint8_t f = 0; f < sizeof(fieldInfo) / sizeof(fieldInfo[0]); f++) {
+    const FieldInfo* info = &fieldInfo[f];
+
+    if (fieldUniform(setups, info)) {
+      continue;
+    }
+
+    append(&r, "%s=%u", info->name, fieldValue(setups, info, 0));
+    for (uint8_t k = 1; k < info->count; k++) {
+      append(&r, ",%u", fieldValue(setups, info, k));
+    }
+    append(&r, "\n");
   }
 
 #else
@@ -531,8 +1496,156 @@ void QT1244::debug(uint8_t no) {
   // Others MCUs
 
 #endif
+
+  return r.len;
+}
+
+#endif
+
+#if defined (QT1244_TUNER)
+
+void QT1244::tuneBegin(void) {
+  memset(tuneTouch, 0xFF, sizeof(tuneTouch));
+  memset(tuneNoise, 0, sizeof(tuneNoise));
+  memset(tuneTouches, 0, sizeof(tuneTouches));
+  memset(tuneNoises, 0, sizeof(tuneNoises));
+}
+
+/*
+	touched: bit k set while key k is held by the operator, clear while it is
+	known to be untouched. Call repeatedly for both states on every key.
+*/
+void QT1244::tuneSample(uint32_t touched) {
+  uint8_t data[QT1244_KEYS * KEY_DATA_SIZE];
+
+  readKeyData(data);
+
+  for (uint8_t k = 0; k < QT1244_KEYS; k++) {
+    uint8_t* set = &data[k * KEY_DATA_SIZE];
+    int32_t signal = set[KEY_DATA_SIGNAL] | (set[KEY_DATA_SIGNAL + 1] << 8);
+    int32_t reference = set[KEY_DATA_REFERENCE] | (set[KEY_DATA_REFERENCE + 1] << 8);
+    int32_t delta = reference - signal;
+
+    // Insert into the kept extremes, pushing the least extreme one out
+    if (touched & (1UL << k)) {
+      if (delta < 0) {
+        delta = 0;
+      }
+      for (uint8_t i = 0; i <= QT1244_TUNE_DISCARD; i++) {
+        if (delta < tuneTouch[k][i]) {
+          uint16_t out = tuneTouch[k][i];
+
+          tuneTouch[k][i] = delta;
+          delta = out;
+        }
+      }
+      if (tuneTouches[k] < 255) {
+        tuneTouches[k]++;
+      }
+    }
+    else {
+      if (delta < 0) {
+        delta = -delta;
+      }
+      for (uint8_t i = 0; i <= QT1244_TUNE_DISCARD; i++) {
+        if (delta > tuneNoise[k][i]) {
+          uint16_t out = tuneNoise[k][i];
+
+          tuneNoise[k][i] = delta;
+          delta = out;
+        }
+      }
+      if (tuneNoises[k] < 255) {
+        tuneNoises[k]++;
+      }
+    }
+  }
+}
+
+/*
+	snr: required touch/noise ratio after scaling to the candidate BL/NDIL.
+	image: SETUPS_SIZE bytes, filled with the defaults, the tuned per-key
+	NTHR/BL and NDIL bytes and a fresh HCRC, ready for setups(image).
+	Keys without more than QT1244_TUNE_DISCARD touch and noise samples, or
+	without a configuration that meets snr, keep the defaults and make the
+	result false.
+*/
+bool QT1244::tuneSolve(uint8_t snr, uint8_t* image) {
+  static const uint8_t blPulses[4] = QT1244_BL_PULSES;
+  static const uint8_t nthrCounts[8] = QT1244_NTHR_COUNTS;
+  bool solved = true;
+
+  defaultSetups(image);
+
+  for (uint8_t k = 0; k < QT1244_KEYS; k++) {
+    uint16_t bestCost = 0xFFFF;
+    uint8_t bestBL = 0, bestNDIL = 0, bestNTHR = 0;
+    uint32_t touchSeen, noiseSeen;
+
+    if ((tuneTouches[k] <= QT1244_TUNE_DISCARD) || (tuneNoises[k] <= QT1244_TUNE_DISCARD)) {
+      solved = false;
+      continue;
+    }
+
+    touchSeen = tuneTouch[k][QT1244_TUNE_DISCARD];
+    noiseSeen = tuneNoise[k][QT1244_TUNE_DISCARD];
+    if (noiseSeen == 0) {
+      noiseSeen = 1;
+    }
+
+    for (uint8_t bl = 0; bl <= 3; bl++) {
+      uint32_t touch = touchSeen * blPulses[bl] / blPulses[BL_VALUE];
+      uint32_t noise = (noiseSeen * blPulses[bl] + blPulses[BL_VALUE] - 1) / blPulses[BL_VALUE];
+      uint32_t middle = (touch + noise) / 2;
+      uint8_t nthr = 0xFF;
+
+      // Threshold strictly between noise and touch, closest to the middle
+      for (uint8_t t = 0; t <= 7; t++) {
+        if ((nthrCounts[t] > noise) && (nthrCounts[t] < touch)) {
+          if ((nthr == 0xFF) ||
+              ((nthrCounts[t] > middle ? nthrCounts[t] - middle : middle - nthrCounts[t]) <
+               (nthrCounts[nthr] > middle ? nthrCounts[nthr] - middle : middle - nthrCounts[nthr]))) {
+            nthr = t;
+          }
+        }
+      }
+      if (nthr == 0xFF) {
+        continue;
+      }
+
+      // touch / (noise / sqrt(ndil)) >= snr
+      for (uint8_t ndil = 1; ndil <= 7; ndil++) {
+        uint16_t cost = blPulses[bl] * ndil;
+
+        if (cost >= bestCost) {
+          break;
+        }
+        if ((uint64_t)touch * touch * ndil >= (uint64_t)snr * snr * noise * noise) {
+          bestCost = cost;
+          bestBL = bl;
+          bestNDIL = ndil;
+          bestNTHR = nthr;
+          break;
+        }
+      }
+    }
+
+    if (bestCost == 0xFFFF) {
+      solved = false;
+      continue;
+    }
+
+    image[NTHR_PTHR_NDRIFT_BL_ADDR - SETUPS_ADDR + k] = (BL_FIELD::put(bestBL) | NDRIFT_FIELD::put(NDRIFT_VALUE) | NTHR_FIELD::put(bestNTHR));
+    image[NDIL_FDIL_AKS_WAKE_ADDR - SETUPS_ADDR + k] = (WAKE_FIELD::put(WAKE_VALUE) | AKS_FIELD::put(AKS_VALUE) | FDIL_FIELD::put(FDIL_VALUE) | NDIL_FIELD::put(bestNDIL));
+  }
+
+  setupsCRC(image);
+
+  return solved;
 }
 
+#endif
+
 /********************************************************************
   16 bits crc calculation. Initial crc entry value must be 0.
   The message is not augmented with 'zero' bits.
@@ -542,6 +1655,50 @@ void QT1244::debug(uint8_t no) {
   repeat this function for each data block byte, folding the result
   back into the call parameter crc
 ********************************************************************/
+#if defined (QT1244_CRC_TABLE)
+
+// One lookup per byte instead of 8 shifts, for 512 bytes of flash
+static const uint16_t crcTable[256] = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+  0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+  0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+  0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+  0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+  0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+  0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+  0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+  0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+  0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+  0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+  0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+  0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+  0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+  0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+  0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+  0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+  0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+  0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+  0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+  0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+  0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+  0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+  0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+  0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+  0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+  0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+  0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+  0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+  0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+  0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
+
+unsigned long CRC16BitCalc(unsigned long crc, unsigned char data) {
+  return ((crc << 8) ^ crcTable[((crc >> 8) ^ data) & 0xFF]) & 0xFFFF;
+}
+
+#else
+
 unsigned long CRC16BitCalc(unsigned long crc, unsigned char data) {
   unsigned char index;  // shift counter
   crc ^= (unsigned long)(data) << 8;
@@ -558,3 +1715,48 @@ unsigned long CRC16BitCalc(unsigned long crc, unsigned char data) {
 
   return crc;
 }
+
+#endif
+
+/********************************************************************
+  Fill a setups block (addresses 141 - 250) from the *_VALUE defaults,
+  every key getting the same per-key bytes, and stamp its HCRC.
+********************************************************************/
+void defaultSetups(uint8_t* image) {
+  for (uint8_t k = 0; k < QT1244_KEYS; k++) {
+    image[NTHR_PTHR_NDRIFT_BL_ADDR - SETUPS_ADDR + k] = (BL_FIELD::put(BL_VALUE) | NDRIFT_FIELD::put(NDRIFT_VALUE) | NTHR_FIELD::put(NTHR_PTHR_VALUE));
+    image[NDIL_FDIL_AKS_WAKE_ADDR - SETUPS_ADDR + k] = (WAKE_FIELD::put(WAKE_VALUE) | AKS_FIELD::put(AKS_VALUE) | FDIL_FIELD::put(FDIL_VALUE) | NDIL_FIELD::put(NDIL_VALUE));
+    image[CFO_1_ADDR - SETUPS_ADDR + k] = CFO_1_VALUE;
+    image[CFO_2_ADDR - SETUPS_ADDR + k] = CFO_2_VALUE;
+  }
+
+  image[NRD_ADDR - SETUPS_ADDR] = NRD_VALUE;
+  image[SLEEP_MSYNC_NHYST_DEBUG_ADDR - SETUPS_ADDR] = (DEBUG_FIELD::put(DEBUG_VALUE) | NHYST_FIELD::put(NHYST_VALUE) | MSYNC_FIELD::put(MSYNC_VALUE) | SLEEP_FIELD::put(SLEEP_VALUE));
+  image[AWAKE_ADDR - SETUPS_ADDR] = AWAKE_VALUE;
+  image[DHT_ADDR - SETUPS_ADDR] = DHT_VALUE;
+  image[PDRIFT_SSYNC_ADDR - SETUPS_ADDR] = (SSYNC_FIELD::put(SSYNC_VALUE) | PDRIFT_FIELD::put(PDRIFT_VALUE));
+  image[LSLlsb_ADDR - SETUPS_ADDR] = LSLlsb_VALUE;
+  image[LSLmsb_KGTT_ADDR - SETUPS_ADDR] = (KGTT_FIELD::put(KGTT_VALUE) | LSLmsb_FIELD::put(LSLmsb_VALUE));
+  image[DWELL_RIB_THRM_FHM_ADDR - SETUPS_ADDR] = (FHM_FIELD::put(FHM_VALUE) | THRM_FIELD::put(THRM_VALUE) | RIB_FIELD::put(RIB_VALUE) | DWELL_FIELD::put(DWELL_VALUE));
+  image[FREQ0_ADDR - SETUPS_ADDR] = FREQ0_VALUE;
+  image[FREQ1_ADDR - SETUPS_ADDR] = FREQ1_VALUE;
+  image[FREQ2_ADDR - SETUPS_ADDR] = FREQ2_VALUE;
+  image[NSTHR_NIL_ADDR - SETUPS_ADDR] = (NIL_FIELD::put(NIL_VALUE) | NSTHR_FIELD::put(NSTHR_VALUE));
+
+  setupsCRC(image);
+}
+
+/********************************************************************
+  Compute the HCRC over addresses 141 - 248 of a setups block and
+  store it at 249 (LSB) and 250 (MSB).
+********************************************************************/
+void setupsCRC(uint8_t* image) {
+  unsigned long crc = 0;
+
+  for (uint8_t i = 0; i < HCRClsb_ADDR - SETUPS_ADDR; i++) {
+    crc = CRC16BitCalc(crc, image[i]);
+  }
+
+  image[HCRClsb_ADDR - SETUPS_ADDR] = crc & 0xFF;
+  image[HCRCmsb_ADDR - SETUPS_ADDR] = (crc >> 8) & 0xFF;
+}
@@ -53,6 +53,79 @@
 #define QT1244_ADDR_3		17
 #define QT1244_ADDR_4		117
 
+#define QT1244_KEYS			24
+
+
+/*******************************************************************************
+  From page 17
+  Section 4.2: I2C Serial Communication Bus
+
+	The memory address pointer auto-increments after every byte, so a block
+	of the memory map can be read or written in a single I2C sequence.
+
+	Define QT1244_I2C_BURST when i2c.h provides qt1244ReadBurst() and
+	qt1244WriteBurst(). Without it the driver falls back to one qt1244Read()
+	or qt1244Write() per byte.
+*******************************************************************************/
+//#define QT1244_I2C_BURST
+
+
+/*******************************************************************************
+  Startup probe
+
+  qt1244Probe() looks for a QT1244 at each of the four addresses and fills
+  a QT1244Device table with the chip ID (address 0) and code version
+  (address 1) of those found, read together in one 2 byte transfer.
+
+  Define QT1244_I2C_PROBE when i2c.h provides qt1244Ack(devAddr), an
+  address-only transfer returning true on ACK (HAL_I2C_IsDeviceReady() with
+  a single trial). The four addresses are then probed back to back before
+  any data is read, and an absent chip costs one NACKed address byte rather
+  than a transfer timeout. Without it, the ID bytes are read from every
+  address and 0x00 / 0xFF, what an unanswered read returns, mean absent.
+
+  Define QT1244_CHIP_ID to the chip ID of the part to also reject devices
+  answering at a QT1244 address with another ID. begin() applies the same
+  checks to its own address.
+*******************************************************************************/
+//#define QT1244_I2C_PROBE
+//#define QT1244_CHIP_ID		0x00
+
+typedef struct {
+	uint8_t addr;				// 7 bits address, QT1244_ADDR_*
+	uint8_t chipId;
+	uint8_t version;		// Major in the high nibble, minor in the low nibble
+	bool present;
+} QT1244Device;
+
+
+/*******************************************************************************
+  Lean build (QT1244_LEAN)
+
+  By default every feature group below is compiled. Define QT1244_LEAN to
+  drop them all and keep only begin(), the resets, changeStatus(), setups(),
+  scanKey(), snapshot() and readKeyData(), then define the groups still
+  needed:
+
+	QT1244_FEATURE_STATUS				HCRCStatus() ... FMEAStatus()
+	QT1244_FEATURE_CALIBRATION	calibrateKeyAll(), calibrateKey()
+	QT1244_FEATURE_PROFILES			setups(image), switchProfile(), set<Field>()
+																and the setups shadow (SETUPS_SIZE bytes of RAM)
+	QT1244_FEATURE_DEBUG				debug()
+
+  QT1244_CRC_TABLE computes the HCRC from a 512 byte table instead of bit by
+  bit: more flash for a faster setups()/switchProfile().
+*******************************************************************************/
+//#define QT1244_LEAN
+//#define QT1244_CRC_TABLE
+
+#if !defined (QT1244_LEAN)
+#define QT1244_FEATURE_STATUS
+#define QT1244_FEATURE_CALIBRATION
+#define QT1244_FEATURE_PROFILES
+#define QT1244_FEATURE_DEBUG
+#endif
+
 
 // QT1244 Registers & Values
 
@@ -64,6 +137,8 @@
   Table 5-1.: Memory Map (Continued)
 
   | Address |                       Use                          | Access |
+  |    0    | Chip ID                                            |  Read  |
+  |    1    | Code version                                       |  Read  |
   |    5    | Device Status. Collection of bit flags             |  Read  |
   |    6    | Detect status for keys 0 to 7, one bit per key     |  Read  |
   |    7    | Detect status for keys 8 to 15, one bit per key    |  Read  |
@@ -76,12 +151,46 @@
   |         | offset for frequency hopping. Write k to calibrate |        |
   |         | key k. Write 0x18 to reset the device.             |        |
 *******************************************************************************/
+#define CHIP_ID_ADDR      0
+#define VERSION_ADDR      1
 #define STATUS_ADDR       5
 #define KEY_0TO7_ADDR     6
 #define KEY_8TO15_ADDR    7
 #define KEY_16TO23_ADDR		8
 #define COMMAND_ADDR      140
 
+// Device Status (address 5) bit flags, see HCRCStatus() ... FMEAStatus()
+#define STATUS_HCRC_ERROR       0x01
+#define STATUS_MAINS_SYNC       0x02
+#define STATUS_CALIBRATING      0x04
+#define STATUS_LSL_FAIL         0x08
+#define STATUS_FMEA_FAIL        0x10
+
+
+/*******************************************************************************
+  From page 19, 20
+  Section 5.1: Introduction
+
+  Table 5-1.: Memory Map (Key data)
+
+  | Address  |                       Use                          | Access |
+  |          | Key data sets, 5 bytes per key:                    |        |
+  | 12 - 131 | key status, signal LSB, signal MSB,                |  Read  |
+  |          | reference LSB, reference MSB                       |        |
+
+  Signal falls below reference while a key is touched, so the touch delta is
+  reference - signal.
+*******************************************************************************/
+#define KEY_DATA_ADDR         12
+#define KEY_DATA_SIZE         5
+
+#define KEY_DATA_STATUS       0
+#define KEY_DATA_SIGNAL       1
+#define KEY_DATA_REFERENCE    3
+
+#define KEY_STATUS_CAL_FAIL       0x80	// Key failed calibration
+#define KEY_STATUS_CALIBRATING    0x40	// Key calibration in progress
+
 
 /*******************************************************************************
   From page 27
@@ -484,6 +593,333 @@
 #define HCRCmsb_ADDR		250
 
 
+/*******************************************************************************
+  Setups block
+
+  Addresses 141 - 250 hold the setups. The per-key registers (NTHR/NDRIFT/BL,
+  NDIL/FDIL/AKS/WAKE, CFO_1, CFO_2) are 24 bytes each, one byte per key.
+  HCRC is the CRC16BitCalc() of addresses 141 - 248, LSB first.
+*******************************************************************************/
+#define SETUPS_ADDR		NTHR_PTHR_NDRIFT_BL_ADDR
+#define SETUPS_SIZE		(HCRCmsb_ADDR - SETUPS_ADDR + 1)
+
+#define MEMORY_MAP_SIZE	(HCRCmsb_ADDR + 1)
+
+
+/*******************************************************************************
+  Differential setups upload
+
+  The driver keeps a shadow copy of the last setups block uploaded with
+  setups(image) or switchProfile(). switchProfile() writes only the bytes
+  that differ from it, as runs: runs separated by up to SETUPS_RUN_GAP
+  unchanged bytes are merged, since resending a byte is cheaper than the
+  address overhead of a new write. The write-enable at COMMAND_ADDR joins
+  the first run when no more than SETUPS_ENABLE_GAP bytes lie between them
+  (any change in the per-key NTHR/BL block), and otherwise goes alone right
+  before it. The protection only comes back on a read, and none comes
+  between the runs. Precomputed profiles are built with qt1244_profile.h.
+  Call invalidateShadow() after the setups were written without the driver
+  (asyncSetups(), another host on the bus); the shadow would otherwise hide
+  bytes that no longer match it.
+
+  QT1244_STRICT_WRITE_ENABLE is for a part whose protection comes back at
+  the end of every write: the upload then goes out as one span from the
+  write-enable through the last changed byte, normally the HCRC.
+*******************************************************************************/
+//#define QT1244_STRICT_WRITE_ENABLE
+
+#define SETUPS_RUN_GAP		2
+#define SETUPS_ENABLE_GAP	QT1244_KEYS
+
+
+/*******************************************************************************
+  Batched configuration
+
+  Between batchBegin() and batchCommit(), set<Field>() only stages its
+  change in the shadow. batchCommand() adds a trailing command
+  (CALIBRATE_KEY_ALL, CALIBRATE_KEY_k, LOW_LEVEL_CAL_AND_OFFSET,
+  FORCE_RESET). batchCommit() then writes write-enable, the changed bytes
+  and the new HCRC as runs (see above), followed by the command: three
+  writes for a per-key threshold change and a recalibration. It returns
+  false, writing nothing, when no batch is open.
+
+  Any read re-enables the write protection, so the shadow is loaded by
+  batchBegin(), before anything is written, and no read comes between the
+  write-enable and the setups data. With QT1244_VERIFY the upload is
+  verified before the command is sent, and batchCommit() returns false,
+  without sending it, if verification fails. A single set<Field>() outside
+  a batch is a batch of one.
+*******************************************************************************/
+#define BATCH_DIRTY_SIZE	((SETUPS_SIZE + 7) / 8)
+
+
+/*******************************************************************************
+  Verified setups upload (QT1244_VERIFY)
+
+  For safety-rated builds. After setups(image) or switchProfile() has
+  written the block, one read of the Device Status, VERIFY_SETTLE_US later,
+  confirms it (switchProfile() waits as long for its own HCRC check without
+  QT1244_VERIFY): the device clears STATUS_HCRC_ERROR only when its setups
+  match their HCRC. If the bit is set, the block is read back in one burst
+  and only the runs differing from the image are rewritten, up to
+  VERIFY_RETRIES times; both then return false if the device still reports
+  a mismatch. setups(void) uploads the defaultSetups() image the same way,
+  HCRC included. Requires QT1244_FEATURE_PROFILES.
+*******************************************************************************/
+//#define QT1244_VERIFY
+
+#define VERIFY_SETTLE_US	1000
+#define VERIFY_RETRIES		2
+
+#if defined (QT1244_VERIFY) && !defined (QT1244_FEATURE_PROFILES)
+#error "QT1244_VERIFY requires QT1244_FEATURE_PROFILES"
+#endif
+
+
+/*******************************************************************************
+  Latency-vs-robustness tuner (QT1244_TUNER)
+
+  The tuner records, per key, the touch and noise deltas seen while the
+  device runs with BL_VALUE. A plain minimum and maximum would let one stray
+  sample (a noise spike, a finger sliding off the key) decide the result, so
+  the QT1244_TUNE_DISCARD most extreme samples of each kind are dropped: the
+  tuner uses the next smallest touch delta and the next largest noise delta,
+  and a key needs more than QT1244_TUNE_DISCARD samples of each. A noise of
+  zero counts as one count, the resolution of the delta. Both scale with the
+  burst length, touch rounded down and noise up, and a detect integrator of
+  n samples divides the effective noise by roughly sqrt(n). tuneSolve()
+  picks, per key, the BL/NDIL pair with the
+  fewest pulses per detection (pulses x NDIL) that still meets the requested
+  touch/noise ratio, with an NTHR strictly between noise and touch, closest
+  to the middle of the gap. FDIL is left at FDIL_VALUE.
+
+  QT1244_BL_PULSES and QT1244_NTHR_COUNTS give the pulses per BL code and the
+  threshold in counts per NTHR code used by that model.
+*******************************************************************************/
+//#define QT1244_TUNER
+
+#define QT1244_BL_PULSES		{ 16, 24, 32, 48 }
+#define QT1244_NTHR_COUNTS	{ 6, 8, 10, 12, 15, 20, 25, 30 }
+#define QT1244_TUNE_DISCARD	2
+
+
+/*******************************************************************************
+  Register field descriptors
+
+  One type per setups field, taken from the tables above: address of the
+  (first) containing byte, bit position, width and number of per-key copies.
+  put() places a value in its bits and get() extracts it, masks and shifts
+  only. QT1244::set<Field>(value) and set<Field, Value>() change a field at
+  runtime, for every key of a per-key field; set<Field>(key, value) changes
+  one key's copy. Only the containing bytes and the HCRC are rewritten,
+  plus the bytes between the write-enable and the first of them when it is
+  attached to it (SETUPS_ENABLE_GAP).
+
+  The *_VALUE defaults are range checked against the field widths at
+  compile time.
+*******************************************************************************/
+template <uint8_t Addr, uint8_t Shift, uint8_t Width, uint8_t Count = 1>
+struct QT1244Field {
+	static const uint8_t addr = Addr;
+	static const uint8_t count = Count;
+	static const uint8_t shift = Shift;
+	static const uint8_t max = (uint8_t)((1U << Width) - 1);
+	static const uint8_t mask = (uint8_t)(max << Shift);
+
+	static constexpr uint8_t put(uint8_t value) { return (uint8_t)((value << Shift) & mask); }
+	static constexpr uint8_t get(uint8_t byte) { return (uint8_t)((byte & mask) >> Shift); }
+	static constexpr bool fits(unsigned value) { return value <= max; }
+};
+
+typedef QT1244Field<NTHR_PTHR_NDRIFT_BL_ADDR, 0, 3, QT1244_KEYS> NTHR_FIELD;
+typedef QT1244Field<NTHR_PTHR_NDRIFT_BL_ADDR, 3, 3, QT1244_KEYS> NDRIFT_FIELD;
+typedef QT1244Field<NTHR_PTHR_NDRIFT_BL_ADDR, 6, 2, QT1244_KEYS> BL_FIELD;
+typedef QT1244Field<NDIL_FDIL_AKS_WAKE_ADDR, 0, 3, QT1244_KEYS> NDIL_FIELD;
+typedef QT1244Field<NDIL_FDIL_AKS_WAKE_ADDR, 3, 3, QT1244_KEYS> FDIL_FIELD;
+typedef QT1244Field<NDIL_FDIL_AKS_WAKE_ADDR, 6, 1, QT1244_KEYS> AKS_FIELD;
+typedef QT1244Field<NDIL_FDIL_AKS_WAKE_ADDR, 7, 1, QT1244_KEYS> WAKE_FIELD;
+typedef QT1244Field<CFO_1_ADDR, 0, 8, QT1244_KEYS> CFO_1_FIELD;
+typedef QT1244Field<CFO_2_ADDR, 0, 8, QT1244_KEYS> CFO_2_FIELD;
+typedef QT1244Field<NRD_ADDR, 0, 8> NRD_FIELD;
+typedef QT1244Field<SLEEP_MSYNC_NHYST_DEBUG_ADDR, 0, 3> SLEEP_FIELD;
+typedef QT1244Field<SLEEP_MSYNC_NHYST_DEBUG_ADDR, 3, 1> MSYNC_FIELD;
+typedef QT1244Field<SLEEP_MSYNC_NHYST_DEBUG_ADDR, 4, 2> NHYST_FIELD;
+typedef QT1244Field<SLEEP_MSYNC_NHYST_DEBUG_ADDR, 6, 2> DEBUG_FIELD;
+typedef QT1244Field<AWAKE_ADDR, 0, 8> AWAKE_FIELD;
+typedef QT1244Field<DHT_ADDR, 0, 8> DHT_FIELD;
+typedef QT1244Field<PDRIFT_SSYNC_ADDR, 0, 3> PDRIFT_FIELD;
+typedef QT1244Field<PDRIFT_SSYNC_ADDR, 3, 5> SSYNC_FIELD;
+typedef QT1244Field<LSLlsb_ADDR, 0, 8> LSLlsb_FIELD;
+typedef QT1244Field<LSLmsb_KGTT_ADDR, 0, 3> LSLmsb_FIELD;
+typedef QT1244Field<LSLmsb_KGTT_ADDR, 4, 4> KGTT_FIELD;
+typedef QT1244Field<DWELL_RIB_THRM_FHM_ADDR, 0, 3> DWELL_FIELD;
+typedef QT1244Field<DWELL_RIB_THRM_FHM_ADDR, 3, 1> RIB_FIELD;
+typedef QT1244Field<DWELL_RIB_THRM_FHM_ADDR, 4, 2> THRM_FIELD;
+typedef QT1244Field<DWELL_RIB_THRM_FHM_ADDR, 6, 2> FHM_FIELD;
+typedef QT1244Field<FREQ0_ADDR, 0, 8> FREQ0_FIELD;
+typedef QT1244Field<FREQ1_ADDR, 0, 8> FREQ1_FIELD;
+typedef QT1244Field<FREQ2_ADDR, 0, 8> FREQ2_FIELD;
+typedef QT1244Field<NSTHR_NIL_ADDR, 0, 4> NSTHR_FIELD;
+typedef QT1244Field<NSTHR_NIL_ADDR, 4, 4> NIL_FIELD;
+
+static_assert(NTHR_FIELD::fits(NTHR_PTHR_VALUE), "NTHR_PTHR_VALUE out of range");
+static_assert(NDRIFT_FIELD::fits(NDRIFT_VALUE), "NDRIFT_VALUE out of range");
+static_assert(BL_FIELD::fits(BL_VALUE), "BL_VALUE out of range");
+static_assert(NDIL_FIELD::fits(NDIL_VALUE), "NDIL_VALUE out of range");
+static_assert(FDIL_FIELD::fits(FDIL_VALUE), "FDIL_VALUE out of range");
+static_assert(AKS_FIELD::fits(AKS_VALUE), "AKS_VALUE out of range");
+static_assert(WAKE_FIELD::fits(WAKE_VALUE), "WAKE_VALUE out of range");
+static_assert(SLEEP_FIELD::fits(SLEEP_VALUE), "SLEEP_VALUE out of range");
+static_assert(MSYNC_FIELD::fits(MSYNC_VALUE), "MSYNC_VALUE out of range");
+static_assert(NHYST_FIELD::fits(NHYST_VALUE), "NHYST_VALUE out of range");
+static_assert(DEBUG_FIELD::fits(DEBUG_VALUE), "DEBUG_VALUE out of range");
+static_assert(PDRIFT_FIELD::fits(PDRIFT_VALUE), "PDRIFT_VALUE out of range");
+static_assert(SSYNC_FIELD::fits(SSYNC_VALUE), "SSYNC_VALUE out of range");
+static_assert(LSLmsb_FIELD::fits(LSLmsb_VALUE), "LSLmsb_VALUE out of range");
+static_assert(KGTT_FIELD::fits(KGTT_VALUE), "KGTT_VALUE out of range");
+static_assert(DWELL_FIELD::fits(DWELL_VALUE), "DWELL_VALUE out of range");
+static_assert(RIB_FIELD::fits(RIB_VALUE), "RIB_VALUE out of range");
+static_assert(THRM_FIELD::fits(THRM_VALUE), "THRM_VALUE out of range");
+static_assert(FHM_FIELD::fits(FHM_VALUE), "FHM_VALUE out of range");
+static_assert(NSTHR_FIELD::fits(NSTHR_VALUE), "NSTHR_VALUE out of range");
+static_assert(NIL_FIELD::fits(NIL_VALUE), "NIL_VALUE out of range");
+
+
+/*******************************************************************************
+  Acquisition-cycle aligned reads (QT1244_SYNC)
+
+  The device updates its key status once per acquisition cycle, whose length
+  depends on MSYNC, DWELL and BL. cycleModel() derives it from a setups
+  block: every key bursts its QT1244_BL_PULSES pulses SYNC_PULSE_NS +
+  DWELL * SYNC_DWELL_NS apart, plus SYNC_KEY_US per key and SYNC_CYCLE_US
+  per cycle; with MSYNC the cycle stretches to the next multiple of
+  SYNC_MAINS_US. The constants are nominal, measure them on the target.
+  The model is the period estimate after construction and after every
+  setups upload.
+
+  cycleEdge() is called with a microsecond timestamp on every CHANGE falling
+  edge (EXTI); each edge marks the end of a cycle. CHANGE only falls when the
+  detect status changes, so an interval may span any number of cycles; only
+  intervals within SYNC_TOLERANCE_PCT of the model are taken as adjacent
+  cycles and refine the estimate by 1/8, the rest only re-anchor it.
+  cycleRead() then reads the detect status once per cycle, SYNC_GUARD_US
+  after the expected end of the cycle, and returns false without bus traffic
+  otherwise. cycleRead() and cycleWait() briefly mask interrupts to read the
+  state cycleEdge() writes; call them from the main loop.
+*******************************************************************************/
+//#define QT1244_SYNC
+
+#define SYNC_PULSE_NS			12000	// Burst pulse spacing at DWELL 0
+#define SYNC_DWELL_NS			500		// Added per DWELL step
+#define SYNC_KEY_US				320		// Per key overhead
+#define SYNC_CYCLE_US			3700	// Per cycle overhead
+#define SYNC_MAINS_US			20000	// Mains period for MSYNC, 16667 at 60 Hz
+#define SYNC_TOLERANCE_PCT	25		// Largest deviation of a learnt period from the model
+#define SYNC_GUARD_US			300		// Delay after the expected end of a cycle
+
+
+/*******************************************************************************
+  Self-healing recalibration (QT1244_SUPERVISOR)
+
+  supervise() is called periodically, e.g. every 100 ms. It reads the key
+  data sets, queues every key flagged KEY_STATUS_CAL_FAIL and recalibrates
+  them one at a time with calibrateKey(), issuing the next one only after
+  the previous has finished (SUPERVISOR_SETTLE_MS, then until its
+  calibrating flag clears or SUPERVISOR_TIMEOUT_MS). Other keys keep
+  scanning throughout.
+
+  A key failing SUPERVISOR_RETRIES times in a row, or more than
+  SUPERVISOR_BUDGET recalibrations within SUPERVISOR_WINDOW_MS, escalates to
+  calibrateKeyAll(), and if that does not help, to softwareReset(). After a
+  reset the supervisor keeps recalibrating single keys within their
+  retries. Every SUPERVISOR_WINDOW_MS after the last escalation gives back
+  one escalation level and one retry per key, so a key that stays failed
+  is retried, and escalated again, at that rate, and recovers without
+  operator action once its fault clears.
+*******************************************************************************/
+//#define QT1244_SUPERVISOR
+
+#if defined (QT1244_SUPERVISOR) && !defined (QT1244_FEATURE_CALIBRATION)
+#error "QT1244_SUPERVISOR requires QT1244_FEATURE_CALIBRATION"
+#endif
+
+#define SUPERVISOR_SETTLE_MS		50
+#define SUPERVISOR_TIMEOUT_MS		3000
+#define SUPERVISOR_RETRIES			3
+#define SUPERVISOR_BUDGET				8
+#define SUPERVISOR_WINDOW_MS		10000
+
+
+/*******************************************************************************
+  Shared-bus arbiter (QT1244_ARBITER)
+
+  When the QT1244 shares its I2C bus with other peripherals, attach it to a
+  QT1244Arbiter (qt1244_arbiter.h) with arbiter(). Key status reads then take
+  precedence over configuration and bulk traffic of the other clients. A
+  setups upload then goes out as one unsplit write from the write-enable
+  through the last changed byte, so no read can come between them.
+*******************************************************************************/
+//#define QT1244_ARBITER
+
+#if defined (QT1244_ARBITER)
+class QT1244Arbiter;
+#endif
+
+
+/*******************************************************************************
+  Usage statistics (QT1244_STATS)
+
+  Press counts, hold-time histograms and calibration failure counts per key,
+  scan rate, coalesced and chord reads and CHANGE-to-read latency
+  (qt1244_stats.h), updated
+  by snapshot(), readKeyData(), cycleRead() and powerIdle(). Without
+  QT1244_STATS none of it is compiled.
+*******************************************************************************/
+//#define QT1244_STATS
+
+#if defined (QT1244_STATS)
+#include "qt1244_stats.h"
+#endif
+
+
+/*******************************************************************************
+  Host low-power idle (QT1244_POWER)
+
+  Replaces a polling loop around changeStatus() / scanKey(). powerIdle() is
+  given the CHANGE pin, configured as a falling edge EXTI. While CHANGE is
+  high (no pending key activity) it stops the MCU in STOP mode; the CHANGE
+  edge wakes it. Interrupts are re-enabled once the system clock is
+  restored, then the detect status is read and returned; reading it also
+  releases CHANGE. If CHANGE is already low, it reads at once. The read
+  runs with the HAL tick going, so the timeouts of the qt1244Read*()
+  transport bound it on a stuck bus; handlers that run first count
+  towards the wake latency.
+
+  Define QT1244_POWER when i2c.h provides:
+	uint32_t qt1244PowerClock(void)	microsecond counter that keeps running
+																	in STOP mode (LPTIM, RTC sub-seconds)
+	void qt1244PowerResume(void)		restore the system clock after STOP
+																	(HSE / PLL, as SystemClock_Config())
+
+  powerStats() reports wakes, the wake latency (STOP exit to detect status
+  read), wakes over POWER_LATENCY_US, and the time asleep and awake.
+*******************************************************************************/
+//#define QT1244_POWER
+
+#define POWER_LATENCY_US		1000	// Wake latency budget
+
+#if defined (QT1244_POWER)
+typedef struct {
+	uint32_t wakes;
+	uint32_t overruns;				// Wakes over POWER_LATENCY_US
+	uint32_t latencyMax;			// us
+	uint32_t latencyAvg;			// us
+	uint64_t sleepUs;
+	uint64_t activeUs;
+	uint16_t dutyPermille;		// Awake share of the total time
+} QT1244PowerStats;
+#endif
+
 class QT1244 {
 	public:
 		QT1244();
@@ -492,20 +928,155 @@ class QT1244 {
 		void hardwareReset(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin);
 		void softwareReset(void);
 		uint8_t changeStatus(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin);
+#if defined (QT1244_FEATURE_STATUS)
 		bool HCRCStatus(void);
 		bool mainSyncErrorStatus(void);
 		bool keyCalibrationStatus(void);
 		bool LSLStatus(void);
 		bool FMEAStatus(void);
+#endif
+#if defined (QT1244_FEATURE_CALIBRATION)
 		bool calibrateKeyAll(void);
 		bool calibrateKey(uint8_t key);
+#endif
 		uint8_t scanKey(void);
-		void debug(uint8_t no);
+		uint32_t snapshot(void);
+		void readKeyData(uint8_t* data);
+#if defined (QT1244_FEATURE_DEBUG)
+		uint16_t debug(char* report, uint16_t size);
+#endif
+#if defined (QT1244_FEATURE_PROFILES)
+		bool setups(const uint8_t* image);
+		bool switchProfile(const uint8_t* image);
+		void batchBegin(void);
+		void batchCommand(uint8_t command);
+		bool batchCommit(void);
+		void invalidateShadow(void);
+
+		// All keys of a per-key field
+		template <class Field>
+		bool set(uint8_t value) {
+			if (!Field::fits(value)) {
+				return false;
+			}
+			return setField(Field::addr, Field::count, Field::mask, Field::put(value));
+		}
+
+		template <class Field>
+		bool set(uint8_t key, uint8_t value) {
+			if (!Field::fits(value) || (key >= Field::count)) {
+				return false;
+			}
+			return setField(Field::addr + key, 1, Field::mask, Field::put(value));
+		}
+
+		// Compile-time checked value, all keys of a per-key field
+		template <class Field, uint8_t Value>
+		bool set(void) {
+			static_assert(Field::fits(Value), "value out of range for field");
+			return setField(Field::addr, Field::count, Field::mask, Field::put(Value));
+		}
+#endif
+#if defined (QT1244_TUNER)
+		void tuneBegin(void);
+		void tuneSample(uint32_t touched);
+		bool tuneSolve(uint8_t snr, uint8_t* image);
+#endif
+#if defined (QT1244_ARBITER)
+		void arbiter(QT1244Arbiter* bus, uint8_t client);
+#endif
+#if defined (QT1244_STATS)
+		bool stats(QT1244StatsData* copy);
+#endif
+#if defined (QT1244_SUPERVISOR)
+		uint32_t supervise(uint32_t now);
+#endif
+#if defined (QT1244_SYNC)
+		void cycleEdge(uint32_t now);
+		bool cycleRead(uint32_t now, uint32_t* keys);
+		uint32_t cycleWait(uint32_t now);
+		uint32_t cyclePeriod(void);
+#endif
+#if defined (QT1244_POWER)
+		uint32_t powerIdle(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin);
+		void powerStats(QT1244PowerStats* copy);
+#endif
 	
 	private:
 		uint8_t DEVADDR;
+#if defined (QT1244_FEATURE_PROFILES)
+		uint8_t SHADOW[SETUPS_SIZE];
+		bool SHADOWVALID;
+		uint8_t BATCHDIRTY[BATCH_DIRTY_SIZE];
+		bool BATCHOPEN;
+		bool BATCHCMD;
+		uint8_t BATCHCOMMAND;
+#endif
+#if defined (QT1244_ARBITER)
+		QT1244Arbiter* BUS;
+		uint8_t CLIENT;
+#endif
+#if defined (QT1244_STATS)
+		QT1244Stats STATS;
+#endif
+#if defined (QT1244_SUPERVISOR)
+		uint8_t HEALSTATE;
+		uint8_t HEALKEY;
+		uint8_t HEALLEVEL;
+		uint8_t HEALTRIES[QT1244_KEYS];
+		uint8_t HEALCOUNT;
+		uint32_t HEALSTART;
+		uint32_t HEALWINDOW;
+		uint32_t HEALFAILING;
+#endif
+#if defined (QT1244_SYNC)
+		volatile uint32_t CYCLEPERIOD;
+		volatile uint32_t CYCLEANCHOR;
+		volatile uint32_t CYCLEMODEL;
+		volatile bool CYCLEEDGE;
+		uint32_t CYCLEREAD;
+		uint32_t CYCLEKEYS;
+#endif
+#if defined (QT1244_POWER)
+		uint32_t POWERWAKES;
+		uint32_t POWEROVERRUNS;
+		uint32_t POWERLATMAX;
+		uint64_t POWERLATSUM;
+		uint64_t POWERSLEEP;
+		uint64_t POWERACTIVE;
+		uint32_t POWERLAST;
+#endif
+		uint8_t readReg(uint8_t regAddr);
+		void writeReg(uint8_t regAddr, uint8_t data);
+		void readRegs(uint8_t regAddr, uint8_t* data, uint16_t len);
+		void writeRegs(uint8_t regAddr, const uint8_t* data, uint16_t len);
+#if defined (QT1244_FEATURE_PROFILES)
+		uint8_t writeRuns(const uint8_t* image, const uint8_t* current, const uint8_t* dirty = 0);
+		bool setField(uint8_t regAddr, uint8_t count, uint8_t mask, uint8_t bits);
+#endif
+#if defined (QT1244_VERIFY)
+		bool verifySetups(const uint8_t* image);
+#endif
+#if defined (QT1244_SYNC)
+		void cycleSetups(const uint8_t* image);
+		uint32_t cycleDue(uint32_t now, uint32_t anchor, uint32_t period);
+#endif
+#if defined (QT1244_TUNER)
+		uint16_t tuneTouch[QT1244_KEYS][QT1244_TUNE_DISCARD + 1];	// Smallest first
+		uint16_t tuneNoise[QT1244_KEYS][QT1244_TUNE_DISCARD + 1];	// Largest first
+		uint8_t tuneTouches[QT1244_KEYS];
+		uint8_t tuneNoises[QT1244_KEYS];
+#endif
 };
 
 unsigned long CRC16BitCalc(unsigned long crc, unsigned char data);
+void qt1244ReadBlock(uint8_t devAddr, uint8_t regAddr, uint8_t* data, uint16_t len);
+void qt1244WriteBlock(uint8_t devAddr, uint8_t regAddr, const uint8_t* data, uint16_t len);
+void defaultSetups(uint8_t* image);
+void setupsCRC(uint8_t* image);
+uint8_t qt1244Probe(QT1244Device* table);
+#if defined (QT1244_SYNC)
+uint32_t cycleModel(const uint8_t* image);
+#endif
 
 #endif /* __QT1244_H */
@@ -0,0 +1,165 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  Shared I2C bus arbiter for the AT42QT1244 and the other peripherals on its bus
+*******************************************************************************************************/
+#include "qt1244.h"
+#include "qt1244_arbiter.h"
+
+
+static bool defaultXfer(ArbiterTransfer* t, uint16_t offset, uint16_t len) {
+#if defined (STM32F4)
+
+  // For MCUs STM32F4xx
+  if (t->write) {
+    qt1244WriteBlock(t->devAddr, t->regAddr + offset, t->data + offset, len);
+  }
+  else {
+    qt1244ReadBlock(t->devAddr, t->regAddr + offset, t->data + offset, len);
+  }
+
+  return true;
+
+#else
+
+  // Others MCUs
+  return false;
+
+#endif
+}
+
+/*
+	clock: free running tick counter used for the occupancy statistics,
+	e.g. DWT->CYCCNT or a microsecond timer.
+*/
+QT1244Arbiter::QT1244Arbiter(uint32_t (*clock)(void)) {
+  CLOCK = clock;
+
+  for (uint8_t p = 0; p < ARBITER_PRIORITIES; p++) {
+    HEAD[p] = 0;
+    COUNT[p] = 0;
+  }
+
+  resetStats();
+}
+
+/*
+	Queue a transfer. The transfer must stay valid until its state leaves
+	ARBITER_QUEUED. Call from one context only (main loop or one task).
+*/
+bool QT1244Arbiter::submit(ArbiterTransfer* t) {
+  uint8_t p = t->priority;
+
+  if ((p >= ARBITER_PRIORITIES) || (t->client >= ARBITER_CLIENTS) || (COUNT[p] == ARBITER_QUEUE_SIZE)) {
+    return false;
+  }
+
+  t->state = ARBITER_QUEUED;
+  t->offset = 0;
+  t->queued = CLOCK();
+
+  QUEUE[p][(HEAD[p] + COUNT[p]) % ARBITER_QUEUE_SIZE] = t;
+  COUNT[p]++;
+
+  return true;
+}
+
+/*
+	Run one I2C transaction of the highest priority pending transfer.
+	Returns false when nothing is queued.
+*/
+bool QT1244Arbiter::poll(void) {
+  for (uint8_t p = 0; p < ARBITER_PRIORITIES; p++) {
+    if (COUNT[p] == 0) {
+      continue;
+    }
+
+    ArbiterTransfer* t = QUEUE[p][HEAD[p]];
+    ArbiterStats* s = &STATS[t->client];
+    uint16_t len = t->len - t->offset;
+    uint32_t start = CLOCK();
+    bool ok;
+
+    if (t->offset == 0) {
+      if (start - t->queued > s->maxWait) {
+        s->maxWait = start - t->queued;
+      }
+    }
+
+    if ((p != ARBITER_PRIORITY_KEYS) && !t->whole && (len > ARBITER_CHUNK_SIZE)) {
+      len = ARBITER_CHUNK_SIZE;
+    }
+
+    ok = (t->xfer ? t->xfer : defaultXfer)(t, t->offset, len);
+
+    s->busy += CLOCK() - start;
+    s->bytes += len;
+    t->offset += len;
+
+    if (!ok || (t->offset >= t->len)) {
+      HEAD[p] = (HEAD[p] + 1) % ARBITER_QUEUE_SIZE;
+      COUNT[p]--;
+      s->transfers++;
+      t->state = ok ? ARBITER_DONE : ARBITER_ERROR;
+      if (t->done) {
+        t->done(t);
+      }
+    }
+
+    return true;
+  }
+
+  return false;
+}
+
+/*
+	Blocking transfer. Pending transfers of the same or a higher priority
+	are served first; lower priority ones wait until this one is done.
+*/
+bool QT1244Arbiter::run(ArbiterTransfer* t) {
+  if (!submit(t)) {
+    return false;
+  }
+
+  while (t->state == ARBITER_QUEUED) {
+    poll();
+  }
+
+  return (t->state == ARBITER_DONE);
+}
+
+const ArbiterStats* QT1244Arbiter::stats(uint8_t client) {
+  return (client < ARBITER_CLIENTS) ? &STATS[client] : 0;
+}
+
+/*
+	Ticks since the last resetStats(). A client's bus occupancy is
+	stats(client)->busy / elapsed().
+*/
+uint32_t QT1244Arbiter::elapsed(void) {
+  return CLOCK() - START;
+}
+
+void QT1244Arbiter::resetStats(void) {
+  for (uint8_t c = 0; c < ARBITER_CLIENTS; c++) {
+    STATS[c].transfers = 0;
+    STATS[c].bytes = 0;
+    STATS[c].busy = 0;
+    STATS[c].maxWait = 0;
+  }
+
+  START = CLOCK();
+}
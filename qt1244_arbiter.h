@@ -0,0 +1,110 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  Shared I2C bus arbiter for the AT42QT1244 and the other peripherals on its bus
+  (EEPROM, temperature sensor, ...). Transfers are queued per priority and run
+  one I2C transaction at a time, so a key status read waits at most for one
+  chunk of a bulk transfer instead of the whole transfer.
+*******************************************************************************************************/
+#ifndef __QT1244_ARBITER_H
+#define __QT1244_ARBITER_H
+
+#include "i2c.h"
+
+
+/*******************************************************************************
+  Priorities, lowest value served first.
+
+  ARBITER_PRIORITY_KEYS  : QT1244 status, detect and key data reads
+  ARBITER_PRIORITY_CONFIG: QT1244 setups and commands, sensor configuration
+  ARBITER_PRIORITY_BULK  : EEPROM pages, telemetry
+
+  Transfers below ARBITER_PRIORITY_KEYS are split into ARBITER_CHUNK_SIZE
+  byte transactions; between two chunks a higher priority transfer may run.
+  A transfer marked whole is never split: the QT1244 sets it on writes from
+  COMMAND_ADDR, since the write-enable must reach the setups in the same
+  transaction, with no read of the device in between.
+*******************************************************************************/
+#define ARBITER_PRIORITY_KEYS     0
+#define ARBITER_PRIORITY_CONFIG   1
+#define ARBITER_PRIORITY_BULK     2
+#define ARBITER_PRIORITIES        3
+
+#define ARBITER_CLIENTS           4
+#define ARBITER_QUEUE_SIZE        8
+#define ARBITER_CHUNK_SIZE        16
+
+#define ARBITER_QUEUED            0
+#define ARBITER_DONE              1
+#define ARBITER_ERROR             2
+
+
+typedef struct ArbiterTransfer ArbiterTransfer;
+
+/*
+	Runs bytes [offset, offset + len) of a transfer as one I2C transaction.
+	Leave xfer at 0 for plain 8-bit register access through qt1244ReadBlock()
+	and qt1244WriteBlock(); devices with 16-bit addressing or write cycle
+	polling (EEPROM) provide their own.
+*/
+typedef bool (*ArbiterXfer)(ArbiterTransfer* t, uint16_t offset, uint16_t len);
+
+struct ArbiterTransfer {
+	uint8_t client;
+	uint8_t priority;
+	uint8_t devAddr;
+	uint16_t regAddr;
+	uint8_t* data;
+	uint16_t len;
+	bool write;
+	bool whole;					// Never split into chunks
+	ArbiterXfer xfer;
+	void (*done)(ArbiterTransfer* t);
+
+	// Owned by the arbiter
+	volatile uint8_t state;
+	uint16_t offset;
+	uint32_t queued;
+};
+
+typedef struct {
+	uint32_t transfers;
+	uint32_t bytes;
+	uint32_t busy;      // clock ticks spent on the bus
+	uint32_t maxWait;   // clock ticks from submit() to the first chunk
+} ArbiterStats;
+
+
+class QT1244Arbiter {
+	public:
+		QT1244Arbiter(uint32_t (*clock)(void));
+		bool submit(ArbiterTransfer* t);
+		bool poll(void);
+		bool run(ArbiterTransfer* t);
+		const ArbiterStats* stats(uint8_t client);
+		uint32_t elapsed(void);
+		void resetStats(void);
+
+	private:
+		uint32_t (*CLOCK)(void);
+		ArbiterTransfer* QUEUE[ARBITER_PRIORITIES][ARBITER_QUEUE_SIZE];
+		uint8_t HEAD[ARBITER_PRIORITIES];
+		uint8_t COUNT[ARBITER_PRIORITIES];
+		ArbiterStats STATS[ARBITER_CLIENTS];
+		uint32_t START;
+};
+
+#endif /* __QT1244_ARBITER_H */
@@ -0,0 +1,231 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  C++20 coroutine API for the AT42QT1244 on hosted (Linux) builds.
+*******************************************************************************************************/
+#include "qt1244_coro.h"
+
+#if defined (__cpp_impl_coroutine)
+
+#include <algorithm>
+#include <functional>
+#include <string.h>
+#include <thread>
+
+
+QT1244Loop::QT1244Loop(const QT1244AsyncBus* bus) {
+  BUS = bus;
+  ACTIVE = 0;
+  TRANSFERS = 0;
+
+  for (uint8_t b = 0; b < QT1244_CORO_BUSES; b++) {
+    RUNNING[b] = 0;
+  }
+}
+
+void QT1244Loop::post(std::coroutine_handle<> h) {
+  READY.push_back(h);
+}
+
+void QT1244Loop::at(Clock::time_point deadline, std::coroutine_handle<> h) {
+  TIMERS.push_back(Timer{deadline, h});
+  std::push_heap(TIMERS.begin(), TIMERS.end(), std::greater<Timer>());
+}
+
+/*
+	Start a task owned by the loop. It is destroyed once it has finished.
+*/
+void QT1244Loop::spawn(QT1244Task<void>&& task) {
+  post(task.handle());
+  SPAWNED.push_back(std::move(task));
+}
+
+void QT1244Loop::queue(Transfer* t) {
+  uint8_t bus = t->dev.bus;
+
+  if (!BUS || (bus >= QT1244_CORO_BUSES)) {
+    t->ok = false;
+    post(t->h);
+    return;
+  }
+
+  WAITING[bus].push_back(t);
+  if (!RUNNING[bus]) {
+    next(bus);
+  }
+}
+
+/*
+	Start the next waiting transfer of bus. Transfers the transport refuses
+	resume at once with false.
+*/
+void QT1244Loop::next(uint8_t bus) {
+  while (!WAITING[bus].empty()) {
+    Transfer* t = WAITING[bus].front();
+
+    WAITING[bus].pop_front();
+    if (BUS->start(bus, t->write, t->dev.devAddr << 1, t->regAddr, t->data, t->len)) {
+      RUNNING[bus] = t;
+      ACTIVE++;
+      TRANSFERS++;
+      return;
+    }
+
+    t->ok = false;
+    post(t->h);
+  }
+}
+
+/*
+	Resume the coroutines whose transfers have finished and start the next
+	transfer on their buses. Returns true if any finished.
+*/
+bool QT1244Loop::complete(void) {
+  bool finished = false;
+
+  for (uint8_t b = 0; b < QT1244_CORO_BUSES; b++) {
+    Transfer* t = RUNNING[b];
+
+    if (t && !BUS->busy(b)) {
+      RUNNING[b] = 0;
+      ACTIVE--;
+      t->ok = !(BUS->error && BUS->error(b));
+      post(t->h);
+      next(b);
+      finished = true;
+    }
+  }
+
+  return finished;
+}
+
+/*
+	Run until every spawned task has finished and nothing is pending. While
+	transfers are running and nothing else is ready, the loop keeps polling
+	the transport; otherwise it sleeps until the next timer.
+*/
+void QT1244Loop::run(void) {
+  while (!READY.empty() || !TIMERS.empty() || ACTIVE) {
+    Clock::time_point now = Clock::now();
+
+    while (!TIMERS.empty() && (TIMERS.front().deadline <= now)) {
+      READY.push_back(TIMERS.front().h);
+      std::pop_heap(TIMERS.begin(), TIMERS.end(), std::greater<Timer>());
+      TIMERS.pop_back();
+    }
+
+    if (ACTIVE) {
+      complete();
+    }
+
+    if (READY.empty()) {
+      if (ACTIVE) {
+        std::this_thread::yield();
+      }
+      else {
+        std::this_thread::sleep_until(TIMERS.front().deadline);
+      }
+      continue;
+    }
+
+    // Only what is ready now; anything posted meanwhile waits a turn
+    for (size_t n = READY.size(); n > 0; n--) {
+      std::coroutine_handle<> h = READY.front();
+
+      READY.pop_front();
+      h.resume();
+    }
+
+    SPAWNED.erase(std::remove_if(SPAWNED.begin(), SPAWNED.end(),
+                                 [](const QT1244Task<void>& t) { return t.done(); }),
+                  SPAWNED.end());
+  }
+}
+
+QT1244Task<bool> asyncSnapshot(QT1244Loop& loop, QT1244AsyncDevice dev, uint32_t* keys) {
+  uint8_t data[3];
+
+  if (!co_await loop.read(dev, KEY_0TO7_ADDR, data, sizeof(data))) {
+    co_return false;
+  }
+
+  *keys = ((uint32_t)data[2] << 16) | ((uint32_t)data[1] << 8) | data[0];
+  co_return true;
+}
+
+QT1244Task<bool> asyncSetups(QT1244Loop& loop, QT1244AsyncDevice dev, const uint8_t* image) {
+  uint8_t block[1 + SETUPS_SIZE];
+  uint8_t status = STATUS_HCRC_ERROR;
+
+  block[0] = SETUPS_WRITE_ENABLE;
+  if (image) {
+    memcpy(&block[1], image, SETUPS_SIZE);
+  }
+  else {
+    defaultSetups(&block[1]);
+  }
+
+  if (!co_await loop.write(dev, COMMAND_ADDR, block, sizeof(block))) {
+    co_return false;
+  }
+
+  co_await loop.sleep((VERIFY_SETTLE_US + 999) / 1000);
+
+  if (!co_await loop.read(dev, STATUS_ADDR, &status, 1)) {
+    co_return false;
+  }
+
+  co_return !(status & STATUS_HCRC_ERROR);
+}
+
+QT1244Task<bool> asyncCalibrate(QT1244Loop& loop, QT1244AsyncDevice dev, uint8_t key, uint32_t timeoutMs) {
+  QT1244Loop::Clock::time_point deadline = QT1244Loop::Clock::now() + std::chrono::milliseconds(timeoutMs);
+  bool all = (key == QT1244_KEYS);
+  uint8_t command = all ? CALIBRATE_KEY_ALL : key;
+  uint8_t regAddr = all ? STATUS_ADDR : KEY_DATA_ADDR + key * KEY_DATA_SIZE + KEY_DATA_STATUS;
+  uint8_t busy = all ? STATUS_CALIBRATING : KEY_STATUS_CALIBRATING;
+  uint8_t status;
+
+  if (key > QT1244_KEYS) {
+    co_return false;
+  }
+
+  if (!co_await loop.write(dev, COMMAND_ADDR, &command, 1)) {
+    co_return false;
+  }
+
+  // The command is taken at the next acquisition cycle, not at once
+  co_await loop.sleep(SUPERVISOR_SETTLE_MS);
+
+  for (;;) {
+    if (!co_await loop.read(dev, regAddr, &status, 1)) {
+      co_return false;
+    }
+    if (!(status & busy)) {
+      co_return all || !(status & KEY_STATUS_CAL_FAIL);
+    }
+    if (QT1244Loop::Clock::now() >= deadline) {
+      co_return false;
+    }
+    co_await loop.sleep(QT1244_CORO_POLL_MS);
+  }
+}
+
+QT1244Task<bool> asyncKeyData(QT1244Loop& loop, QT1244AsyncDevice dev, uint8_t* data) {
+  co_return co_await loop.read(dev, KEY_DATA_ADDR, data, QT1244_KEYS * KEY_DATA_SIZE);
+}
+
+#endif
@@ -0,0 +1,259 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  C++20 coroutine API for the AT42QT1244 on hosted (Linux) builds.
+  One QT1244Loop runs on one thread and drives many devices on several I2C
+  buses through a non-blocking transport: a transfer suspends its coroutine
+  until the bus reports it done, and the loop meanwhile starts transfers on
+  the other buses and runs the coroutines that are ready. Waits such as
+  calibration are timers, so a slow device does not hold up the others.
+*******************************************************************************************************/
+#ifndef __QT1244_CORO_H
+#define __QT1244_CORO_H
+
+#if defined (__cpp_impl_coroutine)
+
+#include <chrono>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <utility>
+#include <vector>
+#include "qt1244.h"
+
+
+#define QT1244_CORO_BUSES     4
+#define QT1244_CORO_POLL_MS   10	// Calibration status poll interval
+
+
+/*
+	Non-blocking transport, one set of functions for all buses.
+
+	start : start writing or reading len bytes at regAddr of devAddr (shifted
+	        left, as the driver passes it to i2c.h) on bus, e.g.
+	        HAL_I2C_Mem_Read_DMA(), or a request to an i2c-dev worker thread.
+	        Returns false on error. data stays valid until busy() is false.
+	busy  : true while the transfer started last on bus is running.
+	error : once busy() is false, true if that transfer failed (NACK, bus
+	        error, DMA error). 0 for a transport that cannot tell; its
+	        transfers then count as done once they are no longer busy.
+
+	The loop starts at most one transfer per bus at a time.
+*/
+typedef struct {
+	bool (*start)(uint8_t bus, bool write, uint8_t devAddr, uint8_t regAddr, uint8_t* data, uint16_t len);
+	bool (*busy)(uint8_t bus);
+	bool (*error)(uint8_t bus);
+} QT1244AsyncBus;
+
+typedef struct {
+	uint8_t bus;
+	uint8_t devAddr;		// 7 bits, as given to QT1244::begin()
+} QT1244AsyncDevice;
+
+
+template <typename T> class QT1244Task;
+
+/*
+	Promise parts shared by QT1244Task<T> and QT1244Task<void>. A task starts
+	when it is awaited or spawned, and resumes its awaiter when it finishes.
+*/
+struct QT1244PromiseBase {
+	std::coroutine_handle<> continuation;
+
+	struct Final {
+		bool await_ready() noexcept { return false; }
+		template <typename P>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+			std::coroutine_handle<> c = h.promise().continuation;
+			return c ? c : std::noop_coroutine();
+		}
+		void await_resume() noexcept {}
+	};
+
+	std::suspend_always initial_suspend() noexcept { return {}; }
+	Final final_suspend() noexcept { return {}; }
+	void unhandled_exception() { std::terminate(); }
+};
+
+template <typename T>
+struct QT1244Promise : QT1244PromiseBase {
+	T value;
+
+	QT1244Task<T> get_return_object();
+	void return_value(T v) { value = std::move(v); }
+	T result(void) { return std::move(value); }
+};
+
+template <>
+struct QT1244Promise<void> : QT1244PromiseBase {
+	QT1244Task<void> get_return_object();
+	void return_void() {}
+	void result(void) {}
+};
+
+template <typename T>
+class QT1244Task {
+	public:
+		typedef QT1244Promise<T> promise_type;
+		typedef std::coroutine_handle<promise_type> handle_type;
+
+		explicit QT1244Task(handle_type h) : H(h) {}
+		QT1244Task(QT1244Task&& other) noexcept : H(std::exchange(other.H, {})) {}
+		QT1244Task(const QT1244Task&) = delete;
+		QT1244Task& operator=(const QT1244Task&) = delete;
+		QT1244Task& operator=(QT1244Task&& other) noexcept {
+			if (this != &other) {
+				if (H) H.destroy();
+				H = std::exchange(other.H, {});
+			}
+			return *this;
+		}
+		~QT1244Task() { if (H) H.destroy(); }
+
+		bool done(void) const { return !H || H.done(); }
+		handle_type handle(void) const { return H; }
+
+		bool await_ready() const noexcept { return done(); }
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> c) noexcept {
+			H.promise().continuation = c;
+			return H;
+		}
+		T await_resume() { return H.promise().result(); }
+
+	private:
+		handle_type H;
+};
+
+template <typename T>
+inline QT1244Task<T> QT1244Promise<T>::get_return_object() {
+	return QT1244Task<T>(QT1244Task<T>::handle_type::from_promise(*this));
+}
+
+inline QT1244Task<void> QT1244Promise<void>::get_return_object() {
+	return QT1244Task<void>(QT1244Task<void>::handle_type::from_promise(*this));
+}
+
+
+class QT1244Loop {
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		// Resume on the next loop turn, after everything already ready
+		struct Yield {
+			QT1244Loop* loop;
+			bool await_ready() const noexcept { return false; }
+			void await_suspend(std::coroutine_handle<> h) { loop->post(h); }
+			void await_resume() const noexcept {}
+		};
+
+		struct Sleep {
+			QT1244Loop* loop;
+			Clock::time_point deadline;
+			bool await_ready() const noexcept { return false; }
+			void await_suspend(std::coroutine_handle<> h) { loop->at(deadline, h); }
+			void await_resume() const noexcept {}
+		};
+
+		/*
+			One I2C transfer. Queued behind the transfers already waiting for
+			the same bus; resumes with false if the transport refused it or
+			reported an error at the end.
+		*/
+		struct Transfer {
+			QT1244Loop* loop;
+			QT1244AsyncDevice dev;
+			bool write;
+			uint8_t regAddr;
+			uint8_t* data;
+			uint16_t len;
+			bool ok;
+			std::coroutine_handle<> h;
+
+			bool await_ready() const noexcept { return false; }
+			void await_suspend(std::coroutine_handle<> c) { h = c; loop->queue(this); }
+			bool await_resume() const noexcept { return ok; }
+		};
+
+		QT1244Loop(const QT1244AsyncBus* bus);
+
+		Yield yield(void) { return Yield{this}; }
+		Sleep sleep(uint32_t ms) { return Sleep{this, Clock::now() + std::chrono::milliseconds(ms)}; }
+		Transfer read(QT1244AsyncDevice dev, uint8_t regAddr, uint8_t* data, uint16_t len) {
+			return Transfer{this, dev, false, regAddr, data, len, false, {}};
+		}
+		Transfer write(QT1244AsyncDevice dev, uint8_t regAddr, const uint8_t* data, uint16_t len) {
+			return Transfer{this, dev, true, regAddr, (uint8_t*)data, len, false, {}};
+		}
+
+		void post(std::coroutine_handle<> h);
+		void at(Clock::time_point deadline, std::coroutine_handle<> h);
+		void spawn(QT1244Task<void>&& task);
+		void run(void);
+		uint32_t transfers(void) const { return TRANSFERS; }
+
+	private:
+		struct Timer {
+			Clock::time_point deadline;
+			std::coroutine_handle<> h;
+			bool operator>(const Timer& other) const { return deadline > other.deadline; }
+		};
+
+		const QT1244AsyncBus* BUS;
+		std::deque<std::coroutine_handle<> > READY;
+		std::vector<Timer> TIMERS;
+		std::vector<QT1244Task<void> > SPAWNED;
+
+		// Per bus: the running transfer and the ones waiting behind it
+		Transfer* RUNNING[QT1244_CORO_BUSES];
+		std::deque<Transfer*> WAITING[QT1244_CORO_BUSES];
+		uint8_t ACTIVE;
+		uint32_t TRANSFERS;
+
+		void queue(Transfer* t);
+		void next(uint8_t bus);
+		bool complete(void);
+};
+
+
+/*
+	Device operations. Each is a sequence of non-blocking transfers, so the
+	operations of devices on different buses overlap on the wire. They talk
+	to the device directly and do not update the state of a QT1244 object
+	(setups shadow, usage statistics): a device also driven through a
+	QT1244 object needs invalidateShadow() on it after asyncSetups().
+
+	asyncSnapshot  : detect status of all 24 keys into keys, bit k for key
+	                 k. False on a transfer error, with keys unchanged.
+	asyncSetups    : write-enable and the block in one transfer, then check
+	                 the HCRC after VERIFY_SETTLE_US. image 0 uploads
+	                 defaultSetups(). False on a transfer error or mismatch.
+	asyncCalibrate : calibrate key (0 - 23), or all keys when key is
+	                 QT1244_KEYS. Waits SUPERVISOR_SETTLE_MS for the device
+	                 to take the command, then polls the calibrating bit of
+	                 the key (of the device status for all keys). False on
+	                 timeout, or when the key reports a failed calibration.
+	asyncKeyData   : the key data sets of all keys, QT1244_KEYS *
+	                 KEY_DATA_SIZE bytes.
+*/
+QT1244Task<bool> asyncSnapshot(QT1244Loop& loop, QT1244AsyncDevice dev, uint32_t* keys);
+QT1244Task<bool> asyncSetups(QT1244Loop& loop, QT1244AsyncDevice dev, const uint8_t* image);
+QT1244Task<bool> asyncCalibrate(QT1244Loop& loop, QT1244AsyncDevice dev, uint8_t key, uint32_t timeoutMs);
+QT1244Task<bool> asyncKeyData(QT1244Loop& loop, QT1244AsyncDevice dev, uint8_t* data);
+
+#endif
+
+#endif /* __QT1244_CORO_H */
@@ -0,0 +1,143 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  Precomputed setups profiles for the AT42QT1244 (normal, glove, wet, ...).
+  Each profile is a complete setups block with its HCRC, built by the
+  compiler and kept in flash; QT1244::switchProfile() uploads only the bytes
+  that differ from the active one.
+
+  Example:
+    static constexpr QT1244Profile GLOVE =
+        qt1244Profile("glove", qt1244Params().withNTHR(1).withBL(3));
+
+    keypad.switchProfile(GLOVE.image);
+*******************************************************************************************************/
+#ifndef __QT1244_PROFILE_H
+#define __QT1244_PROFILE_H
+
+#include "qt1244.h"
+
+
+/*
+	Field values of a profile, same meaning and range as the *_VALUE macros
+	in qt1244.h. The per-key fields apply to all 24 keys. A value out of
+	range for its field fails the constexpr qt1244Profile() at compile time.
+*/
+struct QT1244Params {
+	uint8_t nthr, ndrift, bl;
+	uint8_t ndil, fdil, aks, wake;
+	uint8_t cfo1, cfo2;
+	uint8_t nrd;
+	uint8_t sleep, msync, nhyst, debug;
+	uint8_t awake, dht;
+	uint8_t pdrift, ssync;
+	uint16_t lsl;
+	uint8_t kgtt;
+	uint8_t dwell, rib, thrm, fhm;
+	uint8_t freq0, freq1, freq2;
+	uint8_t nsthr, nil;
+
+	constexpr QT1244Params withNTHR(uint8_t v) const { QT1244Params p = *this; p.nthr = v; return p; }
+	constexpr QT1244Params withBL(uint8_t v) const { QT1244Params p = *this; p.bl = v; return p; }
+	constexpr QT1244Params withNDIL(uint8_t v) const { QT1244Params p = *this; p.ndil = v; return p; }
+	constexpr QT1244Params withFDIL(uint8_t v) const { QT1244Params p = *this; p.fdil = v; return p; }
+	constexpr QT1244Params withAKS(uint8_t v) const { QT1244Params p = *this; p.aks = v; return p; }
+	constexpr QT1244Params withNHYST(uint8_t v) const { QT1244Params p = *this; p.nhyst = v; return p; }
+	constexpr QT1244Params withNRD(uint8_t v) const { QT1244Params p = *this; p.nrd = v; return p; }
+	constexpr QT1244Params withDWELL(uint8_t v) const { QT1244Params p = *this; p.dwell = v; return p; }
+	constexpr QT1244Params withTHRM(uint8_t v) const { QT1244Params p = *this; p.thrm = v; return p; }
+	constexpr QT1244Params withNSTHR(uint8_t v) const { QT1244Params p = *this; p.nsthr = v; return p; }
+	constexpr QT1244Params withNIL(uint8_t v) const { QT1244Params p = *this; p.nil = v; return p; }
+};
+
+// Parameters from the *_VALUE macros, the same setups as defaultSetups()
+constexpr QT1244Params qt1244Params(void) {
+	return QT1244Params {
+		NTHR_PTHR_VALUE, NDRIFT_VALUE, BL_VALUE,
+		NDIL_VALUE, FDIL_VALUE, AKS_VALUE, WAKE_VALUE,
+		CFO_1_VALUE, CFO_2_VALUE,
+		NRD_VALUE,
+		SLEEP_VALUE, MSYNC_VALUE, NHYST_VALUE, DEBUG_VALUE,
+		AWAKE_VALUE, DHT_VALUE,
+		PDRIFT_VALUE, SSYNC_VALUE,
+		(LSLmsb_VALUE << 8) | LSLlsb_VALUE,
+		KGTT_VALUE,
+		DWELL_VALUE, RIB_VALUE, THRM_VALUE, FHM_VALUE,
+		FREQ0_VALUE, FREQ1_VALUE, FREQ2_VALUE,
+		NSTHR_VALUE, NIL_VALUE
+	};
+}
+
+struct QT1244Profile {
+	const char* name;
+	uint8_t image[SETUPS_SIZE];
+};
+
+// Compile-time twin of CRC16BitCalc()
+constexpr unsigned long qt1244CRC(unsigned long crc, unsigned char data) {
+	crc ^= (unsigned long)(data) << 8;
+	for (uint8_t i = 0; i < 8; i++) {
+		crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+	}
+	return crc;
+}
+
+// Not constexpr: reaching it from a constant evaluation is a compile error
+inline uint8_t qt1244ProfileRangeError(void) {
+	return 0;
+}
+
+// Field::put() with the range check put() leaves out
+template <class Field>
+constexpr uint8_t qt1244Put(unsigned value) {
+	return Field::fits(value) ? Field::put(value) : qt1244ProfileRangeError();
+}
+
+constexpr QT1244Profile qt1244Profile(const char* name, const QT1244Params& p) {
+	QT1244Profile profile = { name, {} };
+	uint8_t* image = profile.image;
+	unsigned long crc = 0;
+
+	for (uint8_t k = 0; k < QT1244_KEYS; k++) {
+		image[NTHR_PTHR_NDRIFT_BL_ADDR - SETUPS_ADDR + k] = qt1244Put<BL_FIELD>(p.bl) | qt1244Put<NDRIFT_FIELD>(p.ndrift) | qt1244Put<NTHR_FIELD>(p.nthr);
+		image[NDIL_FDIL_AKS_WAKE_ADDR - SETUPS_ADDR + k] = qt1244Put<WAKE_FIELD>(p.wake) | qt1244Put<AKS_FIELD>(p.aks) | qt1244Put<FDIL_FIELD>(p.fdil) | qt1244Put<NDIL_FIELD>(p.ndil);
+		image[CFO_1_ADDR - SETUPS_ADDR + k] = p.cfo1;
+		image[CFO_2_ADDR - SETUPS_ADDR + k] = p.cfo2;
+	}
+
+	image[NRD_ADDR - SETUPS_ADDR] = p.nrd;
+	image[SLEEP_MSYNC_NHYST_DEBUG_ADDR - SETUPS_ADDR] = qt1244Put<DEBUG_FIELD>(p.debug) | qt1244Put<NHYST_FIELD>(p.nhyst) | qt1244Put<MSYNC_FIELD>(p.msync) | qt1244Put<SLEEP_FIELD>(p.sleep);
+	image[AWAKE_ADDR - SETUPS_ADDR] = p.awake;
+	image[DHT_ADDR - SETUPS_ADDR] = p.dht;
+	image[PDRIFT_SSYNC_ADDR - SETUPS_ADDR] = qt1244Put<SSYNC_FIELD>(p.ssync) | qt1244Put<PDRIFT_FIELD>(p.pdrift);
+	image[LSLlsb_ADDR - SETUPS_ADDR] = p.lsl & 0xFF;
+	image[LSLmsb_KGTT_ADDR - SETUPS_ADDR] = qt1244Put<KGTT_FIELD>(p.kgtt) | qt1244Put<LSLmsb_FIELD>(p.lsl >> 8);
+	image[DWELL_RIB_THRM_FHM_ADDR - SETUPS_ADDR] = qt1244Put<FHM_FIELD>(p.fhm) | qt1244Put<THRM_FIELD>(p.thrm) | qt1244Put<RIB_FIELD>(p.rib) | qt1244Put<DWELL_FIELD>(p.dwell);
+	image[FREQ0_ADDR - SETUPS_ADDR] = p.freq0;
+	image[FREQ1_ADDR - SETUPS_ADDR] = p.freq1;
+	image[FREQ2_ADDR - SETUPS_ADDR] = p.freq2;
+	image[NSTHR_NIL_ADDR - SETUPS_ADDR] = qt1244Put<NIL_FIELD>(p.nil) | qt1244Put<NSTHR_FIELD>(p.nsthr);
+
+	for (uint8_t i = 0; i < HCRClsb_ADDR - SETUPS_ADDR; i++) {
+		crc = qt1244CRC(crc, image[i]);
+	}
+	image[HCRClsb_ADDR - SETUPS_ADDR] = crc & 0xFF;
+	image[HCRCmsb_ADDR - SETUPS_ADDR] = (crc >> 8) & 0xFF;
+
+	return profile;
+}
+
+#endif /* __QT1244_PROFILE_H */
@@ -0,0 +1,157 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  Command queue for using the AT42QT1244 driver from several RTOS tasks.
+*******************************************************************************************************/
+#include "qt1244_queue.h"
+
+
+/*
+	dev: driver object, only touched from the task calling drain().
+	notify: called after every post() to wake the driver task, e.g. a
+	direct-to-task notification. May be 0.
+*/
+QT1244Queue::QT1244Queue(QT1244* dev, void (*notify)(void)) : TAIL(0), HEAD(0) {
+  DEV = dev;
+  NOTIFY = notify;
+
+  for (uint32_t i = 0; i < QUEUE_SIZE; i++) {
+    CELLS[i].seq.store(i, std::memory_order_relaxed);
+  }
+}
+
+/*
+	Any task, lock-free. Returns false when the ring is full; token is then
+	left untouched.
+*/
+bool QT1244Queue::post(uint8_t cmd, uint8_t arg, QueueToken* token, const uint8_t* image) {
+  uint32_t pos = TAIL.load(std::memory_order_relaxed);
+  Cell* cell;
+
+  for (;;) {
+    cell = &CELLS[pos & (QUEUE_SIZE - 1)];
+    int32_t dif = (int32_t)(cell->seq.load(std::memory_order_acquire) - pos);
+
+    if (dif == 0) {
+      if (TAIL.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    }
+    else if (dif < 0) {
+      return false;
+    }
+    else {
+      pos = TAIL.load(std::memory_order_relaxed);
+    }
+  }
+
+  if (token) {
+    token->state.store(QUEUE_PENDING, std::memory_order_relaxed);
+  }
+
+  cell->command.cmd = cmd;
+  cell->command.arg = arg;
+  cell->command.image = image;
+  cell->command.token = token;
+  cell->seq.store(pos + 1, std::memory_order_release);
+
+  if (NOTIFY) {
+    NOTIFY();
+  }
+
+  return true;
+}
+
+bool QT1244Queue::pop(QueueCommand* command) {
+  Cell* cell = &CELLS[HEAD & (QUEUE_SIZE - 1)];
+
+  if (cell->seq.load(std::memory_order_acquire) != HEAD + 1) {
+    return false;
+  }
+
+  *command = cell->command;
+  cell->seq.store(HEAD + QUEUE_SIZE, std::memory_order_release);
+  HEAD++;
+
+  return true;
+}
+
+uint8_t QT1244Queue::execute(const QueueCommand* command) {
+  switch (command->cmd) {
+    case QUEUE_CMD_SETUPS:
+#if defined (QT1244_FEATURE_PROFILES)
+      return command->image ? DEV->setups(command->image) : DEV->setups();
+#else
+      return command->image ? 0 : DEV->setups();
+#endif
+#if defined (QT1244_FEATURE_CALIBRATION)
+    case QUEUE_CMD_CALIBRATE_ALL:
+      return DEV->calibrateKeyAll();
+    case QUEUE_CMD_CALIBRATE_KEY:
+      return DEV->calibrateKey(command->arg);
+#endif
+    case QUEUE_CMD_RESET:
+      DEV->softwareReset();
+      return true;
+    case QUEUE_CMD_SCAN:
+      return DEV->scanKey();
+    default:
+      return 0;
+  }
+}
+
+static void complete(QueueToken* token, uint8_t result) {
+  if (token) {
+    token->result = result;
+    token->state.store(QUEUE_COMPLETE, std::memory_order_release);
+  }
+}
+
+/*
+	Driver task only. Takes everything pending (up to QUEUE_SIZE commands),
+	runs it in order with duplicates coalesced and completes the tokens.
+	Returns the number of commands taken.
+*/
+uint8_t QT1244Queue::drain(void) {
+  QueueCommand batch[QUEUE_SIZE];
+  uint8_t n = 0;
+
+  while ((n < QUEUE_SIZE) && pop(&batch[n])) {
+    n++;
+  }
+
+  for (uint8_t i = 0; i < n; i++) {
+    if (batch[i].cmd == QUEUE_CMD_NONE) {
+      continue;
+    }
+
+    uint8_t result = execute(&batch[i]);
+
+    complete(batch[i].token, result);
+
+    for (uint8_t j = i + 1; j < n; j++) {
+      if ((batch[j].cmd == batch[i].cmd) && (batch[j].arg == batch[i].arg) && (batch[j].image == batch[i].image)) {
+        complete(batch[j].token, result);
+        batch[j].cmd = QUEUE_CMD_NONE;
+      }
+      else if ((batch[j].cmd == QUEUE_CMD_SETUPS) || (batch[j].cmd == QUEUE_CMD_RESET) || (batch[j].cmd == QUEUE_CMD_CALIBRATE_ALL)) {
+        break;
+      }
+    }
+  }
+
+  return n;
+}
@@ -0,0 +1,96 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  Command queue for using the AT42QT1244 driver from several RTOS tasks.
+  Any task posts commands through a lock-free multi-producer/single-consumer
+  ring; one driver task owns the QT1244 object and drains the ring, so no
+  task ever blocks on a mutex held by another one.
+*******************************************************************************************************/
+#ifndef __QT1244_QUEUE_H
+#define __QT1244_QUEUE_H
+
+#include <atomic>
+#include "qt1244.h"
+
+
+/*******************************************************************************
+  Commands
+
+  QUEUE_CMD_SETUPS        : setups(), or setups(image) when image is given
+  QUEUE_CMD_CALIBRATE_ALL : calibrateKeyAll()
+  QUEUE_CMD_CALIBRATE_KEY : calibrateKey(arg)
+  QUEUE_CMD_RESET         : softwareReset()
+  QUEUE_CMD_SCAN          : scanKey(), the key number is the result
+
+  Identical commands pending in the same drain() run once and share the
+  result, unless a different setups, reset or calibrate-all lies between them.
+*******************************************************************************/
+#define QUEUE_SIZE                16	// Power of two
+
+#define QUEUE_CMD_NONE            0
+#define QUEUE_CMD_SETUPS          1
+#define QUEUE_CMD_CALIBRATE_ALL   2
+#define QUEUE_CMD_CALIBRATE_KEY   3
+#define QUEUE_CMD_RESET           4
+#define QUEUE_CMD_SCAN            5
+
+#define QUEUE_PENDING             0
+#define QUEUE_COMPLETE            1
+
+
+/*
+	Completion token. Keep it alive until done() returns true, then read
+	result. A token may be reused once it has completed.
+*/
+struct QueueToken {
+	std::atomic<uint8_t> state;
+	uint8_t result;
+
+	QueueToken() : state(QUEUE_COMPLETE), result(0) {}
+	bool done(void) const { return state.load(std::memory_order_acquire) == QUEUE_COMPLETE; }
+};
+
+typedef struct {
+	uint8_t cmd;
+	uint8_t arg;
+	const uint8_t* image;
+	QueueToken* token;
+} QueueCommand;
+
+
+class QT1244Queue {
+	public:
+		QT1244Queue(QT1244* dev, void (*notify)(void));
+		bool post(uint8_t cmd, uint8_t arg, QueueToken* token, const uint8_t* image = 0);
+		uint8_t drain(void);
+
+	private:
+		struct Cell {
+			std::atomic<uint32_t> seq;
+			QueueCommand command;
+		};
+
+		QT1244* DEV;
+		void (*NOTIFY)(void);
+		Cell CELLS[QUEUE_SIZE];
+		std::atomic<uint32_t> TAIL;
+		uint32_t HEAD;
+
+		bool pop(QueueCommand* command);
+		uint8_t execute(const QueueCommand* command);
+};
+
+#endif /* __QT1244_QUEUE_H */
@@ -0,0 +1,187 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  Per-key usage statistics for the AT42QT1244 (QT1244_STATS).
+*******************************************************************************************************/
+#include <string.h>
+#include "qt1244_stats.h"
+
+
+QT1244Stats::QT1244Stats() : SEQ(0) {
+  reset();
+}
+
+void QT1244Stats::reset(void) {
+  SEQ.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  memset(&DATA, 0, sizeof(DATA));
+  KEYS = 0;
+  FAILED = 0;
+
+  std::atomic_thread_fence(std::memory_order_release);
+  SEQ.fetch_add(1, std::memory_order_relaxed);
+}
+
+/*
+	keys: current detect mask, bit k for key k.
+	now: millisecond timestamp.
+	Only the keys whose bit changed since the last call are visited.
+*/
+void QT1244Stats::edges(uint32_t keys, uint32_t now) {
+  uint32_t changed = (keys ^ KEYS) & 0x00FFFFFF;
+
+  SEQ.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  if (DATA.reads++ == 0) {
+    DATA.firstMs = now;
+  }
+  DATA.lastMs = now;
+
+  if (changed == 0) {
+    DATA.idle++;
+  }
+  else if (changed & (changed - 1)) {
+    DATA.coalesced++;
+  }
+
+  if (keys & (keys - 1) & 0x00FFFFFF) {
+    DATA.chords++;
+  }
+
+  while (changed) {
+    uint8_t k = __builtin_ctz(changed);
+
+    changed &= changed - 1;
+
+    if (keys & (1UL << k)) {
+      DATA.press[k]++;
+      SINCE[k] = now;
+    }
+    else {
+      uint32_t ms = (now - SINCE[k]) / STATS_HOLD_BASE_MS;
+      uint8_t bin = 0;
+
+      while (ms && (bin < STATS_HOLD_BINS - 1)) {
+        ms >>= 1;
+        bin++;
+      }
+      DATA.hold[bin][k]++;
+    }
+  }
+
+  KEYS = keys;
+
+  std::atomic_thread_fence(std::memory_order_release);
+  SEQ.fetch_add(1, std::memory_order_relaxed);
+}
+
+/*
+	failed: mask of keys currently flagged as failing calibration. Each
+	newly failing key counts once.
+*/
+void QT1244Stats::calibration(uint32_t failed) {
+  uint32_t rising = failed & ~FAILED & 0x00FFFFFF;
+
+  FAILED = failed;
+
+  if (rising == 0) {
+    return;
+  }
+
+  SEQ.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  while (rising) {
+    DATA.calFail[__builtin_ctz(rising)]++;
+    rising &= rising - 1;
+  }
+
+  std::atomic_thread_fence(std::memory_order_release);
+  SEQ.fetch_add(1, std::memory_order_relaxed);
+}
+
+/*
+	us: microseconds from a CHANGE edge to the read of the detect status.
+*/
+void QT1244Stats::latency(uint32_t us) {
+  uint32_t steps = us / STATS_LATENCY_BASE_US;
+  uint8_t bin = 0;
+
+  while (steps && (bin < STATS_LATENCY_BINS - 1)) {
+    steps >>= 1;
+    bin++;
+  }
+
+  SEQ.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  DATA.latency[bin]++;
+
+  std::atomic_thread_fence(std::memory_order_release);
+  SEQ.fetch_add(1, std::memory_order_relaxed);
+}
+
+/*
+	Consistent copy of the counters without stopping the updates: the copy
+	is retried while an update is in progress, up to STATS_READ_TRIES
+	times. Returns false, with copy undefined, when every try met an
+	update; a reader that preempted the updating task must let it run
+	before trying again.
+*/
+bool QT1244Stats::read(QT1244StatsData* copy) const {
+  for (uint8_t tries = 0; tries < STATS_READ_TRIES; tries++) {
+    uint32_t seq = SEQ.load(std::memory_order_acquire);
+
+    if (seq & 1) {
+      continue;
+    }
+
+    memcpy(copy, &DATA, sizeof(DATA));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (SEQ.load(std::memory_order_relaxed) == seq) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/*
+	Upper bound, in microseconds, of the latency bin holding the given
+	percentile (0 - 100); 0 when nothing has been recorded, and 0xFFFFFFFF
+	when it falls in the open-ended last bin.
+*/
+uint32_t statsPercentile(const QT1244StatsData* data, uint8_t percent) {
+  uint64_t total = 0, seen = 0;
+
+  for (uint8_t b = 0; b < STATS_LATENCY_BINS; b++) {
+    total += data->latency[b];
+  }
+  if (total == 0) {
+    return 0;
+  }
+
+  for (uint8_t b = 0; b < STATS_LATENCY_BINS - 1; b++) {
+    seen += data->latency[b];
+    if (seen * 100 >= total * percent) {
+      return (uint32_t)STATS_LATENCY_BASE_US << b;
+    }
+  }
+
+  return 0xFFFFFFFF;
+}
@@ -0,0 +1,117 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  Per-key usage statistics for the AT42QT1244 (QT1244_STATS): press counts,
+  hold-time histograms and calibration failure counts for wear analysis,
+  plus scan throughput counters. Fed from the 24-bit detect edges of
+  snapshot(), so an update costs one step per changed key.
+*******************************************************************************************************/
+#ifndef __QT1244_STATS_H
+#define __QT1244_STATS_H
+
+#include <atomic>
+#include <stdint.h>
+
+
+/*******************************************************************************
+  Hold-time histogram
+
+  Bin 0 counts holds shorter than STATS_HOLD_BASE_MS, bin b holds from
+  STATS_HOLD_BASE_MS << (b - 1) up to STATS_HOLD_BASE_MS << b, the last bin
+  everything longer.
+*******************************************************************************/
+#define STATS_HOLD_BINS       8
+#define STATS_HOLD_BASE_MS    32
+
+
+/*******************************************************************************
+  Scan throughput
+
+  Counted on every snapshot() read:
+	reads				reads, reads / (lastMs - firstMs) the achieved scan rate
+	idle				reads with no change, duplicates on an event-driven path
+	coalesced		reads where more than one key changed since the previous read:
+							edges of different keys merged into one read
+	chords			reads with more than one key down
+
+  They only see what the reads see. A tap that starts and ends between two
+  reads changes nothing and counts as idle, not coalesced, and scanKey()
+  does not count at all: it returns the key of the first status byte
+  holding exactly one key, so keys 0 and 8 together read as key 1, and
+  keys 0 and 1 together as no key. Event loss, duplicates and latency
+  against the real touches are measured by test/bench_soak.cpp.
+
+  latency is a histogram of the end-to-end latency, from the CHANGE edge to
+  the read, of cycleRead() (QT1244_SYNC) and powerIdle() (QT1244_POWER).
+  Bin 0 counts latencies below STATS_LATENCY_BASE_US, bin b up to
+  STATS_LATENCY_BASE_US << b, the last bin everything longer.
+  statsPercentile() returns the upper bound of the bin holding a percentile.
+*******************************************************************************/
+#define STATS_LATENCY_BINS    12
+#define STATS_LATENCY_BASE_US 64
+
+
+/*******************************************************************************
+  Reading the counters
+
+  read() never blocks: it retries a copy that met an update STATS_READ_TRIES
+  times, then returns false. On a single core, a reader of higher priority
+  than the scanning task may have preempted it in the middle of an update
+  that only finishes once the reader yields, so a false return means: wait
+  (e.g. osDelay(1)) and read again.
+*******************************************************************************/
+#define STATS_READ_TRIES      4
+
+
+/*
+	Structure of arrays: each counter kind is contiguous over the keys, so an
+	update only touches the lines of the counters it changes and an export
+	is a few straight copies.
+*/
+typedef struct {
+	uint32_t press[24];
+	uint16_t hold[STATS_HOLD_BINS][24];
+	uint16_t calFail[24];
+	uint32_t reads;
+	uint32_t idle;
+	uint32_t coalesced;
+	uint32_t chords;
+	uint32_t firstMs;
+	uint32_t lastMs;
+	uint32_t latency[STATS_LATENCY_BINS];
+} QT1244StatsData;
+
+
+class QT1244Stats {
+	public:
+		QT1244Stats();
+		void reset(void);
+		void edges(uint32_t keys, uint32_t now);
+		void calibration(uint32_t failed);
+		void latency(uint32_t us);
+		bool read(QT1244StatsData* copy) const;
+
+	private:
+		QT1244StatsData DATA;
+		uint32_t SINCE[24];
+		uint32_t KEYS;
+		uint32_t FAILED;
+		std::atomic<uint32_t> SEQ;
+};
+
+uint32_t statsPercentile(const QT1244StatsData* data, uint8_t percent);
+
+#endif /* __QT1244_STATS_H */
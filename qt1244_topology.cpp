@@ -0,0 +1,211 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  Topology layer for consoles with more AT42QT1244 keypads than one bus allows.
+*******************************************************************************************************/
+#include "qt1244_topology.h"
+
+
+QT1244Topology::QT1244Topology(const TopologyBus* bus) {
+  BUS = bus;
+  COUNT = 0;
+  REVERSE = false;
+  SWITCHES = 0;
+
+  for (uint8_t c = 0; c < TOPOLOGY_CONTROLLERS; c++) {
+    LENGTH[c] = 0;
+    OPENMUX[c] = TOPOLOGY_NO_MUX;
+    OPENCHANNEL[c] = 0;
+  }
+}
+
+/*
+	devAddr: 7 bit address, one of QT1244_ADDR_1..4.
+	muxAddr: 7 bit address of the mux, TOPOLOGY_NO_MUX when the keypad sits
+	directly on the controller. Call plan() after the last add().
+	Returns the logical keypad number, -1 when the table is full or the
+	keypad would share the bus with another device at the same address.
+*/
+int8_t QT1244Topology::add(uint8_t controller, uint8_t muxAddr, uint8_t channel, uint8_t devAddr) {
+  if ((COUNT == TOPOLOGY_KEYPADS) || (controller >= TOPOLOGY_CONTROLLERS) || (channel > 7)) {
+    return -1;
+  }
+  if ((devAddr != QT1244_ADDR_1) && (devAddr != QT1244_ADDR_2) &&
+      (devAddr != QT1244_ADDR_3) && (devAddr != QT1244_ADDR_4)) {
+    return -1;
+  }
+
+  // The direct segment is connected whenever a channel is open, so a direct
+  // keypad collides with every keypad of its address on the controller;
+  // behind muxes, only keypads on the same channel of the same mux do. A mux
+  // must not answer at the address of any keypad of its bus either.
+  for (uint8_t i = 0; i < COUNT; i++) {
+    const TopologyKeypad* k = &KEYPADS[i];
+
+    if (k->controller != controller) {
+      continue;
+    }
+    if ((k->devAddr == muxAddr) || (k->muxAddr == devAddr)) {
+      return -1;
+    }
+    if ((k->devAddr == devAddr) &&
+        ((k->muxAddr == TOPOLOGY_NO_MUX) || (muxAddr == TOPOLOGY_NO_MUX) ||
+         ((k->muxAddr == muxAddr) && (k->channel == channel)))) {
+      return -1;
+    }
+  }
+
+  KEYPADS[COUNT].controller = controller;
+  KEYPADS[COUNT].muxAddr = muxAddr;
+  KEYPADS[COUNT].channel = channel;
+  KEYPADS[COUNT].devAddr = devAddr;
+
+  return COUNT++;
+}
+
+/*
+	Group the keypads of every controller by (mux, channel): keypads behind
+	the same channel are read back to back, so each channel is opened once
+	per scan. Direct keypads come first, since they need no mux at all.
+*/
+void QT1244Topology::plan(void) {
+  for (uint8_t c = 0; c < TOPOLOGY_CONTROLLERS; c++) {
+    LENGTH[c] = 0;
+  }
+
+  for (uint8_t i = 0; i < COUNT; i++) {
+    uint8_t c = KEYPADS[i].controller;
+    uint16_t key = ((KEYPADS[i].muxAddr == TOPOLOGY_NO_MUX) ? 0 : ((KEYPADS[i].muxAddr + 1) << 3)) | KEYPADS[i].channel;
+    uint8_t j = LENGTH[c]++;
+
+    // Insertion sort on (mux, channel)
+    while (j > 0) {
+      const TopologyKeypad* prev = &KEYPADS[ORDER[c][j - 1]];
+      uint16_t prevKey = ((prev->muxAddr == TOPOLOGY_NO_MUX) ? 0 : ((prev->muxAddr + 1) << 3)) | prev->channel;
+
+      if (prevKey <= key) {
+        break;
+      }
+      ORDER[c][j] = ORDER[c][j - 1];
+      j--;
+    }
+    ORDER[c][j] = i;
+  }
+}
+
+/*
+	Open the path to a keypad on its controller. A channel of another mux
+	on the same bus is closed first, otherwise both segments would be
+	connected at once. Direct keypads are reachable with any channel open;
+	add() keeps their addresses off every mux segment.
+*/
+bool QT1244Topology::route(uint8_t keypad) {
+  const TopologyKeypad* k = &KEYPADS[keypad];
+  uint8_t c = k->controller;
+
+  if (k->muxAddr == TOPOLOGY_NO_MUX) {
+    return true;
+  }
+  if ((OPENMUX[c] == k->muxAddr) && (OPENCHANNEL[c] == k->channel)) {
+    return true;
+  }
+
+  if ((OPENMUX[c] != TOPOLOGY_NO_MUX) && (OPENMUX[c] != k->muxAddr)) {
+    if (!BUS->mux(c, OPENMUX[c], 0)) {
+      return false;
+    }
+    SWITCHES++;
+  }
+
+  OPENMUX[c] = TOPOLOGY_NO_MUX;
+  if (!BUS->mux(c, k->muxAddr, 1 << k->channel)) {
+    return false;
+  }
+  OPENMUX[c] = k->muxAddr;
+  OPENCHANNEL[c] = k->channel;
+  SWITCHES++;
+
+  return true;
+}
+
+/*
+	Read the detect status (addresses 6 - 8) of every keypad, all
+	controllers in parallel. keys[n] receives the 24-bit mask of logical
+	keypad n, 0 when its read failed. Every other scan walks the order
+	backwards, so the channel left open by one scan is the first one
+	needed by the next. Returns the number of keypads read.
+*/
+uint8_t QT1244Topology::scan(uint32_t* keys) {
+  uint8_t buffer[TOPOLOGY_CONTROLLERS][3];
+  uint8_t step[TOPOLOGY_CONTROLLERS];
+  int8_t active[TOPOLOGY_CONTROLLERS];
+  uint8_t done = 0, pending;
+
+  for (uint8_t c = 0; c < TOPOLOGY_CONTROLLERS; c++) {
+    step[c] = 0;
+    active[c] = -1;
+  }
+
+  do {
+    pending = 0;
+
+    for (uint8_t c = 0; c < TOPOLOGY_CONTROLLERS; c++) {
+      if ((active[c] >= 0) && BUS->busy(c)) {
+        pending++;
+        continue;
+      }
+
+      // Collect the finished read
+      if (active[c] >= 0) {
+        keys[active[c]] = ((uint32_t)buffer[c][2] << 16) | ((uint32_t)buffer[c][1] << 8) | buffer[c][0];
+        active[c] = -1;
+        done++;
+      }
+
+      // Start the next one
+      while (step[c] < LENGTH[c]) {
+        uint8_t n = REVERSE ? LENGTH[c] - 1 - step[c] : step[c];
+        uint8_t keypad = ORDER[c][n];
+
+        step[c]++;
+        keys[keypad] = 0;
+
+        if (route(keypad) && BUS->read(c, KEYPADS[keypad].devAddr, KEY_0TO7_ADDR, buffer[c], 3)) {
+          active[c] = keypad;
+          pending++;
+          break;
+        }
+      }
+    }
+  } while (pending);
+
+  REVERSE = !REVERSE;
+
+  return done;
+}
+
+/*
+	Open the mux path to a keypad for configuration traffic (setups,
+	calibration) through a QT1244 object on that controller.
+*/
+bool QT1244Topology::select(uint8_t keypad) {
+  return (keypad < COUNT) && route(keypad);
+}
+
+// Mux channel writes since construction, the cost plan() minimises
+uint32_t QT1244Topology::switches(void) {
+  return SWITCHES;
+}
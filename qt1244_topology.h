@@ -0,0 +1,87 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  Topology layer for consoles with more AT42QT1244 keypads than the four
+  strap addresses of one bus: logical keypads are mapped onto (I2C
+  controller, TCA9548A-style mux channel, address). Controllers are scanned
+  concurrently with non-blocking (DMA) reads, and the scan order per
+  controller keeps mux channel switches to a minimum. add() refuses keypads
+  that could answer together with another device on the same bus: a direct
+  keypad and any keypad at its address on the same controller, two keypads
+  at one address behind the same channel, and muxes at a keypad address.
+*******************************************************************************************************/
+#ifndef __QT1244_TOPOLOGY_H
+#define __QT1244_TOPOLOGY_H
+
+#include "qt1244.h"
+
+
+#define TOPOLOGY_CONTROLLERS    4
+#define TOPOLOGY_KEYPADS        16
+#define TOPOLOGY_NO_MUX         0xFF	// Keypad directly on the controller
+
+
+/*
+	Bus backend, one set of functions for all controllers.
+
+	read    : start reading len bytes at regAddr of devAddr on controller,
+	          typically HAL_I2C_Mem_Read_DMA(). Returns false on error.
+	busy    : true while the read started last on controller is running.
+	mux     : write the channel mask (bit n for channel n, 0 for none) to the
+	          mux at muxAddr on controller; may block, it is one byte.
+*/
+typedef struct {
+	bool (*read)(uint8_t controller, uint8_t devAddr, uint8_t regAddr, uint8_t* data, uint16_t len);
+	bool (*busy)(uint8_t controller);
+	bool (*mux)(uint8_t controller, uint8_t muxAddr, uint8_t channels);
+} TopologyBus;
+
+typedef struct {
+	uint8_t controller;
+	uint8_t muxAddr;
+	uint8_t channel;
+	uint8_t devAddr;
+} TopologyKeypad;
+
+
+class QT1244Topology {
+	public:
+		QT1244Topology(const TopologyBus* bus);
+		int8_t add(uint8_t controller, uint8_t muxAddr, uint8_t channel, uint8_t devAddr);
+		void plan(void);
+		uint8_t scan(uint32_t* keys);
+		bool select(uint8_t keypad);
+		uint32_t switches(void);
+
+	private:
+		const TopologyBus* BUS;
+		TopologyKeypad KEYPADS[TOPOLOGY_KEYPADS];
+		uint8_t COUNT;
+
+		// Scan order per controller, keypad indexes grouped by mux channel
+		uint8_t ORDER[TOPOLOGY_CONTROLLERS][TOPOLOGY_KEYPADS];
+		uint8_t LENGTH[TOPOLOGY_CONTROLLERS];
+		bool REVERSE;
+
+		// Open mux channel per controller
+		uint8_t OPENMUX[TOPOLOGY_CONTROLLERS];
+		uint8_t OPENCHANNEL[TOPOLOGY_CONTROLLERS];
+		uint32_t SWITCHES;
+
+		bool route(uint8_t keypad);
+};
+
+#endif /* __QT1244_TOPOLOGY_H */
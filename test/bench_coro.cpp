@@ -0,0 +1,279 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  QT1244Loop benchmark against a simulated non-blocking transport. Every
+  bus takes 22.5 us per byte in real time; four simulated devices sit on
+  each bus and run their acquisition cycles in step with the wall clock.
+
+  Each device is scanned with asyncSnapshot() as fast as the loop allows
+  while the first device of every bus also uploads and checks its setups
+  and recalibrates a key. The same workload runs twice:
+
+    blocking : start() waits for the wire before returning, which is what
+               a loop over the blocking driver calls amounts to
+    async    : start() returns at once and the loop polls busy()
+
+  and reports the achieved snapshot rate, wire utilisation per bus and the
+  CPU time of the loop thread. Usage: bench_coro [ms per run]
+*******************************************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "qt1244_coro.h"
+#include "qt1244_sim.h"
+
+
+#define BENCH_BUSES       QT1244_CORO_BUSES
+#define BENCH_DEVICES     4					// Per bus, one per strap address
+#define BENCH_CAL_KEY     3
+
+typedef QT1244Loop::Clock Clock;
+
+typedef struct {
+	bool running;
+	bool write;
+	QT1244Sim* dev;
+	uint8_t regAddr;
+	uint8_t* data;
+	uint16_t len;
+	uint64_t doneNs;
+	uint64_t wireNs;
+} BenchBus;
+
+static const uint8_t address[BENCH_DEVICES] = { QT1244_ADDR_1, QT1244_ADDR_2, QT1244_ADDR_3, QT1244_ADDR_4 };
+
+static QT1244Sim* device[BENCH_BUSES][BENCH_DEVICES];
+static BenchBus bus[BENCH_BUSES];
+static bool blocking;
+static Clock::time_point origin;
+
+static uint64_t elapsedNs(void) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - origin).count();
+}
+
+static uint64_t threadCpuNs(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// The bytes move when the transfer ends; the devices have cycled up to then
+static void finish(uint8_t b) {
+  BenchBus* t = &bus[b];
+
+  simRunUntil(t->doneNs);
+
+  for (uint16_t i = 0; i < t->len; i++) {
+    if (t->write) {
+      t->dev->write(t->regAddr + i, t->data[i]);
+    }
+    else {
+      t->data[i] = t->dev->read(t->regAddr + i);
+    }
+  }
+  if (t->write) {
+    t->dev->endWrite();
+  }
+  else {
+    t->dev->endRead();
+  }
+
+  t->running = false;
+}
+
+static bool benchStart(uint8_t b, bool write, uint8_t devAddr, uint8_t regAddr, uint8_t* data, uint16_t len) {
+  BenchBus* t = &bus[b];
+  uint64_t now = elapsedNs();
+  uint64_t bytes = write ? 2 + len : 3 + len;
+
+  if (t->running) {
+    return false;
+  }
+
+  t->dev = 0;
+  for (uint8_t d = 0; d < BENCH_DEVICES; d++) {
+    if (device[b][d] && (device[b][d]->addr == (devAddr >> 1))) {
+      t->dev = device[b][d];
+    }
+  }
+  if (!t->dev) {
+    return false;		// No ACK
+  }
+
+  t->running = true;
+  t->write = write;
+  t->regAddr = regAddr;
+  t->data = data;
+  t->len = len;
+  t->doneNs = now + bytes * SIM_BYTE_NS;
+  t->wireNs += bytes * SIM_BYTE_NS;
+
+  if (blocking) {
+    while (elapsedNs() < t->doneNs) {
+    }
+    finish(b);
+  }
+
+  return true;
+}
+
+static bool benchBusy(uint8_t b) {
+  BenchBus* t = &bus[b];
+
+  if (!t->running) {
+    return false;
+  }
+  if (elapsedNs() < t->doneNs) {
+    return true;
+  }
+
+  finish(b);
+
+  return false;
+}
+
+static const QT1244AsyncBus benchTransport = { benchStart, benchBusy, 0 };
+
+typedef struct {
+	uint32_t snapshots;
+	uint32_t wrong;
+} BenchScan;
+
+static QT1244Task<void> scanner(QT1244Loop& loop, QT1244AsyncDevice dev, QT1244Sim* sim, Clock::time_point end, BenchScan* scan) {
+  while (Clock::now() < end) {
+    uint32_t keys = 0;
+    bool ok = co_await asyncSnapshot(loop, dev, &keys);
+
+    SIM_CHECK(ok);
+
+    // Calibrating keys drop out of detect, but no other key may appear
+    scan->snapshots++;
+    if (keys & ~sim->touch) {
+      scan->wrong++;
+    }
+  }
+}
+
+/*
+	Setups upload with a good and a corrupted HCRC, then a key
+	recalibration that must only complete once the device has finished it.
+*/
+static QT1244Task<void> configure(QT1244Loop& loop, QT1244AsyncDevice dev, QT1244Sim* sim) {
+  uint8_t image[SETUPS_SIZE];
+  uint8_t data[QT1244_KEYS * KEY_DATA_SIZE];
+
+  defaultSetups(image);
+  image[NRD_ADDR - SETUPS_ADDR] ^= 1;
+  SIM_CHECK(!co_await asyncSetups(loop, dev, image));
+  SIM_CHECK(co_await asyncSetups(loop, dev, 0));
+
+  sim->calFail = 0;
+  SIM_CHECK(co_await asyncCalibrate(loop, dev, BENCH_CAL_KEY, 1000));
+  SIM_CHECK(!sim->calibrating());
+  SIM_CHECK(co_await asyncKeyData(loop, dev, data));
+  SIM_CHECK(!(data[BENCH_CAL_KEY * KEY_DATA_SIZE + KEY_DATA_STATUS] & (KEY_STATUS_CALIBRATING | KEY_STATUS_CAL_FAIL)));
+
+  sim->calFail = 1UL << BENCH_CAL_KEY;
+  SIM_CHECK(!co_await asyncCalibrate(loop, dev, BENCH_CAL_KEY, 1000));
+  SIM_CHECK(!sim->calibrating());
+
+  SIM_CHECK(co_await asyncCalibrate(loop, dev, QT1244_KEYS, 1000));
+  SIM_CHECK(!sim->calibrating());
+}
+
+static QT1244Task<void> absent(QT1244Loop& loop, uint8_t b) {
+  QT1244AsyncDevice dev = { b, 0x30 };
+
+  SIM_CHECK(!co_await asyncSetups(loop, dev, 0));
+}
+
+static void run(uint8_t buses, bool block, uint32_t ms) {
+  QT1244Loop loop(&benchTransport);
+  BenchScan scan[BENCH_BUSES][BENCH_DEVICES];
+  uint64_t cpu, ns, wire = 0;
+  uint32_t snapshots = 0, wrong = 0;
+
+  simReset();
+  memset(device, 0, sizeof(device));
+  memset(bus, 0, sizeof(bus));
+  memset(scan, 0, sizeof(scan));
+  blocking = block;
+
+  for (uint8_t b = 0; b < buses; b++) {
+    for (uint8_t d = 0; d < BENCH_DEVICES; d++) {
+      device[b][d] = new QT1244Sim(address[d]);
+      device[b][d]->touch = (1UL << (b * BENCH_DEVICES + d)) | 0x800000;
+      simAttach(device[b][d]);
+    }
+  }
+
+  // Let the touches reach the detect status before timing starts
+  simAdvance(2 * SIM_PERIOD_NS);
+  origin = Clock::now() - std::chrono::nanoseconds(simBus.now);
+
+  Clock::time_point end = Clock::now() + std::chrono::milliseconds(ms);
+
+  for (uint8_t b = 0; b < buses; b++) {
+    for (uint8_t d = 0; d < BENCH_DEVICES; d++) {
+      QT1244AsyncDevice dev = { b, address[d] };
+
+      loop.spawn(scanner(loop, dev, device[b][d], end, &scan[b][d]));
+    }
+    loop.spawn(configure(loop, QT1244AsyncDevice{ b, address[0] }, device[b][0]));
+    loop.spawn(absent(loop, b));
+  }
+
+  cpu = threadCpuNs();
+  ns = elapsedNs();
+  loop.run();
+  cpu = threadCpuNs() - cpu;
+  ns = elapsedNs() - ns;
+
+  for (uint8_t b = 0; b < buses; b++) {
+    wire += bus[b].wireNs;
+    for (uint8_t d = 0; d < BENCH_DEVICES; d++) {
+      snapshots += scan[b][d].snapshots;
+      wrong += scan[b][d].wrong;
+      SIM_CHECK(scan[b][d].snapshots > 0);
+      SIM_CHECK(device[b][d]->protectedWrites == 0);
+      delete device[b][d];
+    }
+  }
+  SIM_CHECK(wrong == 0);
+
+  printf("%-8s  %5u  %7u  %9.0f  %10.0f  %7.0f%%  %6.0f%%\n",
+         block ? "blocking" : "async", buses, buses * BENCH_DEVICES,
+         snapshots * 1e9 / ns, snapshots * 1e9 / ns / (buses * BENCH_DEVICES),
+         100.0 * wire / ns / buses, 100.0 * cpu / ns);
+}
+
+int main(int argc, char** argv) {
+  uint32_t ms = (argc > 1) ? atoi(argv[1]) : 1000;
+
+  printf("bench_coro: %u ms per run, %u ns per byte\n", ms, SIM_BYTE_NS);
+  printf("mode      buses  devices  snaps/s  per device  wire/bus     cpu\n");
+
+  for (uint8_t buses = 1; buses <= BENCH_BUSES; buses *= 2) {
+    run(buses, true, ms);
+    run(buses, false, ms);
+  }
+
+  printf("bench_coro: %s\n", simFailures ? "FAILED" : "passed");
+
+  return simFailures ? 1 : 0;
+}
@@ -0,0 +1,503 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  Soak benchmark: sustained scan rate and event loss under synthetic touch
+  storms, in simulated time. A seeded generator drives the touches of a
+  simulated QT1244 (detect integrator of SOAK_INTEGRATOR cycles) with rapid
+  taps, chords, noise bursts and key calibrations issued during activity,
+  each at a controlled mean rate. Every detect edge the device publishes is
+  recorded as ground truth, and every key press a read path reports is
+  matched against it:
+
+    lost        device presses never reported
+    duplicate   a device press reported more than once
+    spurious    a report with no device press behind it
+    undetected  touches the device itself never reported (too short, or
+                during a calibration of the key); not a driver loss
+
+  Latency is from the touch to its report, as percentiles, and at most
+  from the detect edge to its report, which is the driver's share. The
+  read paths:
+
+    scanKey      scanKey() back to back, a press is a new non-zero result
+    scanKey/10   scanKey() every SOAK_POLL_US
+    snapshot/10  snapshot() every SOAK_POLL_US, a press is a rising bit
+    CHANGE       snapshot() SOAK_SERVICE_US after every CHANGE edge
+
+  The QT1244_STATS counters of each run are printed alongside, as the
+  driver saw it; they take no part in the results. The same seed gives the
+  same report. Usage: bench_soak [simulated s per run]
+*******************************************************************************************************/
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "qt1244.h"
+#include "qt1244_sim.h"
+
+
+#define SOAK_SEED         0x1244
+#define SOAK_INTEGRATOR   2
+#define SOAK_POLL_US      10000
+#define SOAK_SERVICE_US   200
+#define SOAK_SPREAD_MS    20					// Onsets of the keys of a chord
+#define SOAK_WARMUP_NS    1000000000ULL	// No touches before, so the device settles
+#define SOAK_TAIL_NS      1000000000ULL	// No touches after end - tail, so the last ones are read
+#define SOAK_CAL_ALL      8						// One calibration in SOAK_CAL_ALL is of all keys
+
+typedef struct {
+	const char* name;
+	uint16_t tapGapMs;				// Mean time between tap onsets, 0 for none
+	uint16_t tapMinMs;
+	uint16_t tapMaxMs;
+	uint16_t chordGapMs;			// Mean time between chords of 2 - 4 keys, 0 for none
+	uint16_t chordMinMs;
+	uint16_t chordMaxMs;
+	uint16_t noiseGapMs;			// Mean time between noise bursts, 0 for none
+	uint8_t noiseCycles;			// Cycles a burst lasts
+	uint16_t calGapMs;				// Mean time between calibrations, 0 for none
+} SoakPattern;
+
+static const SoakPattern patterns[] = {
+	//  name         taps            chords          noise      cal
+	{ "taps",       150, 40, 150,     0,  0,   0,     0, 0,     0 },
+	{ "rapid",       40, 20,  60,     0,  0,   0,     0, 0,     0 },
+	{ "chords",       0,  0,   0,   400, 80, 300,     0, 0,     0 },
+	{ "noise",      150, 40, 150,     0,  0,   0,   500, 4,     0 },
+	{ "calibrate",  150, 40, 150,     0,  0,   0,     0, 0,   200 },
+	{ "storm",       60, 20, 150,   500, 80, 300,   700, 3,   300 },
+};
+
+#define PATH_SCANKEY      0
+#define PATH_SNAPSHOT     1
+#define PATH_CHANGE       2
+
+typedef struct {
+	const char* name;
+	uint8_t mode;
+	uint32_t pollUs;					// 0: back to back
+} SoakPath;
+
+static const SoakPath paths[] = {
+	{ "scanKey",     PATH_SCANKEY,  0 },
+	{ "scanKey/10",  PATH_SCANKEY,  SOAK_POLL_US },
+	{ "snapshot/10", PATH_SNAPSHOT, SOAK_POLL_US },
+	{ "CHANGE",      PATH_CHANGE,   0 },
+};
+
+typedef struct {
+	uint8_t key;
+	uint64_t startNs;
+	uint64_t endNs;
+	bool detected;
+} SoakTouch;
+
+typedef struct {
+	uint64_t ns;
+	uint32_t touch;						// Index in touches
+	bool down;
+} SoakEdge;
+
+typedef struct {
+	uint64_t ns;
+	uint8_t key;							// QT1244_KEYS: all keys
+} SoakCal;
+
+// A detect edge published by the device
+typedef struct {
+	uint64_t edgeNs;
+	uint64_t onsetNs;					// Touch start, 0 for noise or a re-detection
+	bool noise;
+	uint32_t reports;
+} SoakPress;
+
+typedef struct {
+	uint32_t scans;
+	uint32_t busPct;
+	uint32_t touches;
+	uint32_t undetected;
+	uint32_t presses;
+	uint32_t noise;
+	uint32_t lost;
+	uint32_t duplicates;
+	uint32_t spurious;
+	uint32_t latencyUs[4];		// p50, p90, p99, max, touch to report
+	uint32_t worstEdgeUs;			// Detect edge to report
+	QT1244StatsData stats;
+} SoakResult;
+
+static uint32_t rng;
+static const SoakPattern* pattern;
+static std::vector<SoakTouch> touches;
+static std::vector<SoakEdge> edges;
+static std::vector<uint64_t> bursts;
+static std::vector<SoakCal> cals;
+static std::vector<SoakPress> presses;
+static std::vector<uint32_t> latency;
+static size_t nextEdge;
+static size_t nextBurst;
+static uint8_t noiseLeft;
+static int32_t touching[QT1244_KEYS];	// Touch holding key k, -1 for none
+static int32_t latest[QT1244_KEYS];		// Last device press of key k, -1 for none
+static uint32_t published;
+static uint64_t worstEdgeNs;
+
+// xorshift32: the same sequence on every host
+static uint32_t random32(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+
+  return rng;
+}
+
+static uint32_t uniform(uint32_t lo, uint32_t hi) {
+  return lo + random32() % (hi - lo + 1);
+}
+
+// Gaps uniform over 0 - 2 * mean, so the rate is 1 / mean
+static uint64_t gapNs(uint16_t meanMs) {
+  return (uint64_t)uniform(1, 2 * meanMs) * 1000000ULL;
+}
+
+static bool edgeBefore(const SoakEdge& a, const SoakEdge& b) {
+  return a.ns < b.ns;
+}
+
+static bool touchBefore(const SoakTouch& a, const SoakTouch& b) {
+  return a.startNs < b.startNs;
+}
+
+/*
+	Touches, noise bursts and calibrations from SOAK_WARMUP_NS up to
+	endNs - SOAK_TAIL_NS. A touch of a key still held is dropped.
+*/
+static void generate(uint32_t seed, uint64_t endNs) {
+  std::vector<SoakTouch> all;
+  uint64_t last = endNs - SOAK_TAIL_NS;
+  uint64_t held[QT1244_KEYS] = { 0 };
+  uint64_t ns;
+
+  rng = seed;
+  touches.clear();
+  edges.clear();
+  bursts.clear();
+  cals.clear();
+
+  for (ns = SOAK_WARMUP_NS; pattern->tapGapMs && (ns < last); ns += gapNs(pattern->tapGapMs)) {
+    SoakTouch t = { (uint8_t)uniform(0, QT1244_KEYS - 1), ns, 0, false };
+
+    t.endNs = ns + uniform(pattern->tapMinMs, pattern->tapMaxMs) * 1000000ULL;
+    all.push_back(t);
+  }
+
+  for (ns = SOAK_WARMUP_NS; pattern->chordGapMs && (ns < last); ns += gapNs(pattern->chordGapMs)) {
+    uint8_t keys = uniform(2, 4);
+    uint64_t hold = uniform(pattern->chordMinMs, pattern->chordMaxMs) * 1000000ULL;
+
+    for (uint8_t i = 0; i < keys; i++) {
+      SoakTouch t = { (uint8_t)uniform(0, QT1244_KEYS - 1), ns + uniform(0, SOAK_SPREAD_MS) * 1000000ULL, 0, false };
+
+      t.endNs = ns + hold;
+      all.push_back(t);
+    }
+  }
+
+  for (ns = SOAK_WARMUP_NS; pattern->noiseGapMs && (ns < last); ns += gapNs(pattern->noiseGapMs)) {
+    bursts.push_back(ns);
+  }
+
+  for (ns = SOAK_WARMUP_NS; pattern->calGapMs && (ns < last); ns += gapNs(pattern->calGapMs)) {
+    SoakCal c = { ns, (uint8_t)uniform(0, QT1244_KEYS - 1) };
+
+    if (uniform(1, SOAK_CAL_ALL) == 1) {
+      c.key = QT1244_KEYS;
+    }
+    cals.push_back(c);
+  }
+
+  std::stable_sort(all.begin(), all.end(), touchBefore);
+
+  for (size_t i = 0; i < all.size(); i++) {
+    SoakTouch* t = &all[i];
+
+    if ((t->startNs <= held[t->key]) || (t->endNs <= t->startNs)) {
+      continue;
+    }
+    held[t->key] = t->endNs;
+
+    SoakEdge down = { t->startNs, (uint32_t)touches.size(), true };
+    SoakEdge up = { t->endNs, (uint32_t)touches.size(), false };
+
+    edges.push_back(down);
+    edges.push_back(up);
+    touches.push_back(*t);
+  }
+
+  std::stable_sort(edges.begin(), edges.end(), edgeBefore);
+}
+
+/*
+	After every device cycle: record the detect edges it published, then
+	set the touches and noise the next cycle will see.
+*/
+static void cycled(QT1244Sim* dev) {
+  uint32_t detect = dev->detect();
+  uint32_t rising = detect & ~published;
+
+  while (rising) {
+    uint8_t k = __builtin_ctz(rising);
+    SoakPress p = { simBus.now, 0, touching[k] < 0, 0 };
+
+    rising &= rising - 1;
+
+    if (!p.noise && !touches[touching[k]].detected) {
+      p.onsetNs = touches[touching[k]].startNs;
+      touches[touching[k]].detected = true;
+    }
+    latest[k] = presses.size();
+    presses.push_back(p);
+  }
+  published = detect;
+
+  for (; (nextEdge < edges.size()) && (edges[nextEdge].ns < dev->nextNs); nextEdge++) {
+    const SoakEdge* e = &edges[nextEdge];
+    uint8_t k = touches[e->touch].key;
+
+    if (e->down) {
+      dev->touch |= 1UL << k;
+      touching[k] = e->touch;
+    }
+    else {
+      dev->touch &= ~(1UL << k);
+      touching[k] = -1;
+    }
+  }
+
+  for (; (nextBurst < bursts.size()) && (bursts[nextBurst] < dev->nextNs); nextBurst++) {
+    noiseLeft = pattern->noiseCycles;
+  }
+  if (noiseLeft) {
+    dev->noise = (1UL << uniform(0, QT1244_KEYS - 1)) | (1UL << uniform(0, QT1244_KEYS - 1));
+    noiseLeft--;
+  }
+}
+
+// A press of key k reported by the path under test at the current time
+static void report(uint8_t k, SoakResult* r) {
+  SoakPress* p;
+
+  if (latest[k] < 0) {
+    r->spurious++;
+    return;
+  }
+
+  p = &presses[latest[k]];
+  if (p->reports++) {
+    r->duplicates++;
+    return;
+  }
+
+  if (p->onsetNs) {
+    latency.push_back((uint32_t)((simBus.now - p->onsetNs) / 1000));
+  }
+  if (simBus.now - p->edgeNs > worstEdgeNs) {
+    worstEdgeNs = simBus.now - p->edgeNs;
+  }
+}
+
+static void run(uint8_t n, const SoakPath* path, uint32_t seconds, SoakResult* r) {
+  QT1244Sim sim(QT1244_ADDR_1);
+  QT1244 dev;
+  uint64_t endNs = (uint64_t)seconds * 1000000000ULL;
+  uint64_t startNs, next = 0;
+  uint32_t keys = 0, bytes;
+  uint8_t last = 0;
+  size_t cal = 0;
+
+  memset(r, 0, sizeof(*r));
+  pattern = &patterns[n];
+  generate(SOAK_SEED + n, endNs);
+  presses.clear();
+  latency.clear();
+  nextEdge = 0;
+  nextBurst = 0;
+  noiseLeft = 0;
+  published = 0;
+  worstEdgeNs = 0;
+  for (uint8_t k = 0; k < QT1244_KEYS; k++) {
+    touching[k] = -1;
+    latest[k] = -1;
+  }
+
+  simReset();
+  simAttach(&sim);
+  sim.integrator = SOAK_INTEGRATOR;
+  simBus.cycled = cycled;
+  SIM_CHECK(dev.begin(QT1244_ADDR_1));
+
+  startNs = simBus.now;
+  bytes = simBus.bytes;
+
+  for (;;) {
+    if ((path->mode == PATH_CHANGE) && sim.change) {
+      uint32_t now;
+
+      simAdvance(SOAK_SERVICE_US * 1000ULL);
+      now = dev.snapshot();
+      r->scans++;
+      for (uint32_t rising = now & ~keys; rising; rising &= rising - 1) {
+        report(__builtin_ctz(rising), r);
+      }
+      keys = now;
+      continue;
+    }
+
+    uint64_t due = (path->mode == PATH_CHANGE) ? simNextCycle() : next;
+
+    if ((cal < cals.size()) && (cals[cal].ns <= due)) {
+      simRunUntil(cals[cal].ns);
+      if (cals[cal].key == QT1244_KEYS) {
+        dev.calibrateKeyAll();
+      }
+      else {
+        dev.calibrateKey(cals[cal].key);
+      }
+      cal++;
+      continue;
+    }
+    if (due >= endNs) {
+      break;
+    }
+    simRunUntil(due);
+
+    if (path->mode == PATH_SCANKEY) {
+      uint8_t key = dev.scanKey();
+
+      r->scans++;
+      if (key && (key != last)) {
+        report(key - 1, r);
+      }
+      last = key;
+    }
+    else if (path->mode == PATH_SNAPSHOT) {
+      uint32_t now = dev.snapshot();
+
+      r->scans++;
+      for (uint32_t rising = now & ~keys; rising; rising &= rising - 1) {
+        report(__builtin_ctz(rising), r);
+      }
+      keys = now;
+    }
+
+    next += path->pollUs * 1000ULL;
+    if (next < simBus.now) {
+      next = simBus.now;
+    }
+  }
+
+  simBus.cycled = 0;
+
+  r->scans = (uint32_t)(r->scans * 1e9 / (endNs - startNs));
+  r->busPct = (uint32_t)(100.0 * (simBus.bytes - bytes) * SIM_BYTE_NS / (endNs - startNs));
+  r->touches = touches.size();
+  for (size_t i = 0; i < touches.size(); i++) {
+    r->undetected += !touches[i].detected;
+  }
+  r->presses = presses.size();
+  for (size_t i = 0; i < presses.size(); i++) {
+    r->noise += presses[i].noise;
+    r->lost += (presses[i].reports == 0);
+  }
+
+  std::sort(latency.begin(), latency.end());
+  if (!latency.empty()) {
+    r->latencyUs[0] = latency[(latency.size() - 1) * 50 / 100];
+    r->latencyUs[1] = latency[(latency.size() - 1) * 90 / 100];
+    r->latencyUs[2] = latency[(latency.size() - 1) * 99 / 100];
+    r->latencyUs[3] = latency.back();
+  }
+  r->worstEdgeUs = (uint32_t)(worstEdgeNs / 1000);
+
+  SIM_CHECK(dev.stats(&r->stats));
+
+  SIM_CHECK(r->spurious == 0);
+  SIM_CHECK(sim.protectedWrites == 0);
+  if (path->mode != PATH_SCANKEY) {
+    SIM_CHECK(r->lost == 0);
+    SIM_CHECK(r->duplicates == 0);
+  }
+  if (path->mode == PATH_CHANGE) {
+    SIM_CHECK(r->worstEdgeUs <= SOAK_SERVICE_US + 1000);
+  }
+}
+
+static void print(uint8_t pattern, const SoakPath* path, const SoakResult* r) {
+  printf("%-10s %-11s %7u %4u%% %7u %6u %7u %5u %6u %5u %4u %6.1f %6.1f %6.1f %6.1f %6.1f\n",
+         patterns[pattern].name, path->name, r->scans, r->busPct, r->touches, r->undetected,
+         r->presses, r->noise, r->lost, r->duplicates, r->spurious,
+         r->latencyUs[0] / 1000.0, r->latencyUs[1] / 1000.0, r->latencyUs[2] / 1000.0, r->latencyUs[3] / 1000.0,
+         r->worstEdgeUs / 1000.0);
+}
+
+static void printStats(uint8_t pattern, const SoakPath* path, const SoakResult* r) {
+  printf("%-10s %-11s %8u %8u %9u %8u\n",
+         patterns[pattern].name, path->name, r->stats.reads, r->stats.idle, r->stats.coalesced, r->stats.chords);
+}
+
+int main(int argc, char** argv) {
+  uint32_t seconds = (argc > 1) ? atoi(argv[1]) : 3600;
+  const uint8_t count = sizeof(patterns) / sizeof(patterns[0]);
+  const uint8_t ways = sizeof(paths) / sizeof(paths[0]);
+  std::vector<SoakResult> results(count * ways);
+  SoakResult again;
+
+  if (seconds * 1000000000ULL < 2 * (SOAK_WARMUP_NS + SOAK_TAIL_NS)) {
+    seconds = 2 * (SOAK_WARMUP_NS + SOAK_TAIL_NS) / 1000000000ULL;
+  }
+
+  printf("bench_soak: %u s per run, seed 0x%X, %u ns per byte, %llu us cycle, integrator %u\n",
+         seconds, SOAK_SEED, SIM_BYTE_NS, (unsigned long long)(SIM_PERIOD_NS / 1000), SOAK_INTEGRATOR);
+  printf("                                           presses                       touch to report, ms   edge\n");
+  printf("pattern    path        scans/s  bus touches undet.     all noise   lost   dup spur    p50    p90    p99    max    max\n");
+
+  for (uint8_t p = 0; p < count; p++) {
+    for (uint8_t w = 0; w < ways; w++) {
+      run(p, &paths[w], seconds, &results[p * ways + w]);
+      print(p, &paths[w], &results[p * ways + w]);
+    }
+  }
+
+  printf("QT1244_STATS, inputs only (scanKey() does not feed them)\n");
+  printf("pattern    path           reads     idle coalesced   chords\n");
+  for (uint8_t p = 0; p < count; p++) {
+    for (uint8_t w = 0; w < ways; w++) {
+      if (paths[w].mode != PATH_SCANKEY) {
+        printStats(p, &paths[w], &results[p * ways + w]);
+      }
+    }
+  }
+
+  // Repeatable: the same seed gives the same report
+  for (uint8_t w = 0; w < ways; w++) {
+    run(count - 1, &paths[w], seconds, &again);
+    SIM_CHECK(memcmp(&again, &results[(count - 1) * ways + w], sizeof(again)) == 0);
+  }
+
+  printf("bench_soak: %s\n", simFailures ? "FAILED" : "passed");
+
+  return simFailures ? 1 : 0;
+}
@@ -0,0 +1,232 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  QT1244Topology on a simulated multi-bus backend, in simulated time.
+  Every controller has its own DMA read in flight (22.5 us per byte); mux
+  channel writes block the caller, and every busy() poll costs
+  BENCH_POLL_NS of CPU. A read is answered by every device reachable at
+  its address: the direct segment plus the open channel of every mux, with
+  the data wired-ANDed when more than one answers.
+
+  Checks that add() refuses colliding layouts and that valid layouts read
+  every keypad's own detect status, then scans 16 keypads (384 keys)
+  spread over 1, 2 and 4 controllers and reports the scan rate.
+*******************************************************************************************************/
+#include <string.h>
+#include <vector>
+#include "qt1244_topology.h"
+#include "qt1244_sim.h"
+
+
+#define BENCH_KEYPADS     16
+#define BENCH_SCANS       200
+#define BENCH_POLL_NS     500
+#define BENCH_MUX_1       0x70
+#define BENCH_MUX_2       0x71
+
+typedef struct {
+	uint8_t controller;
+	uint8_t muxAddr;
+	uint8_t channel;
+	QT1244Sim* sim;
+} BenchKeypad;
+
+static const uint8_t address[4] = { QT1244_ADDR_1, QT1244_ADDR_2, QT1244_ADDR_3, QT1244_ADDR_4 };
+
+static std::vector<BenchKeypad> placed;
+static uint8_t channels[TOPOLOGY_CONTROLLERS][128];
+static uint64_t until[TOPOLOGY_CONTROLLERS];
+static uint32_t collisions;
+static uint32_t muxWrites;
+
+static bool reachable(const BenchKeypad* k) {
+  return (k->muxAddr == TOPOLOGY_NO_MUX) || (channels[k->controller][k->muxAddr] & (1 << k->channel));
+}
+
+static bool benchRead(uint8_t controller, uint8_t devAddr, uint8_t regAddr, uint8_t* data, uint16_t len) {
+  uint8_t answers = 0;
+
+  memset(data, 0xFF, len);
+
+  for (size_t i = 0; i < placed.size(); i++) {
+    BenchKeypad* k = &placed[i];
+
+    if ((k->controller != controller) || (k->sim->addr != devAddr) || !reachable(k)) {
+      continue;
+    }
+    for (uint16_t j = 0; j < len; j++) {
+      data[j] &= k->sim->read(regAddr + j);
+    }
+    k->sim->endRead();
+    answers++;
+  }
+
+  if (answers == 0) {
+    return false;
+  }
+  if (answers > 1) {
+    collisions++;
+  }
+
+  until[controller] = simBus.now + (uint64_t)(3 + len) * SIM_BYTE_NS;
+
+  return true;
+}
+
+static bool benchBusy(uint8_t controller) {
+  simAdvance(BENCH_POLL_NS);
+
+  return simBus.now < until[controller];
+}
+
+static bool benchMux(uint8_t controller, uint8_t muxAddr, uint8_t mask) {
+  channels[controller][muxAddr] = mask;
+  muxWrites++;
+  simAdvance(2 * SIM_BYTE_NS);
+
+  return true;
+}
+
+static const TopologyBus benchBus = { benchRead, benchBusy, benchMux };
+
+static void benchReset(void) {
+  for (size_t i = 0; i < placed.size(); i++) {
+    delete placed[i].sim;
+  }
+  placed.clear();
+  memset(channels, 0, sizeof(channels));
+  memset(until, 0, sizeof(until));
+  collisions = 0;
+  muxWrites = 0;
+  simReset();
+}
+
+// Place a simulated keypad and add it; returns the add() result
+static int8_t place(QT1244Topology* topology, uint8_t controller, uint8_t muxAddr, uint8_t channel, uint8_t devAddr) {
+  int8_t n = topology->add(controller, muxAddr, channel, devAddr);
+
+  if (n >= 0) {
+    BenchKeypad k = { controller, muxAddr, channel, new QT1244Sim(devAddr) };
+
+    k.sim->touch = 1UL << n;
+    simAttach(k.sim);
+    placed.push_back(k);
+  }
+
+  return n;
+}
+
+static void testCollisions(void) {
+  QT1244Topology topology(&benchBus);
+
+  benchReset();
+
+  SIM_CHECK(place(&topology, 0, TOPOLOGY_NO_MUX, 0, QT1244_ADDR_1) == 0);
+  // Same address behind a mux on the same controller
+  SIM_CHECK(place(&topology, 0, BENCH_MUX_1, 0, QT1244_ADDR_1) < 0);
+  // Same address direct twice
+  SIM_CHECK(place(&topology, 0, TOPOLOGY_NO_MUX, 3, QT1244_ADDR_1) < 0);
+  // Not a QT1244 address
+  SIM_CHECK(place(&topology, 0, BENCH_MUX_1, 0, 0x30) < 0);
+  // Mux at a keypad address
+  SIM_CHECK(place(&topology, 0, QT1244_ADDR_1, 0, QT1244_ADDR_2) < 0);
+
+  SIM_CHECK(place(&topology, 0, BENCH_MUX_1, 0, QT1244_ADDR_2) == 1);
+  // Same channel of the same mux
+  SIM_CHECK(place(&topology, 0, BENCH_MUX_1, 0, QT1244_ADDR_2) < 0);
+  // Other channel, other mux and other controller are separate segments
+  SIM_CHECK(place(&topology, 0, BENCH_MUX_1, 1, QT1244_ADDR_2) == 2);
+  SIM_CHECK(place(&topology, 0, BENCH_MUX_2, 0, QT1244_ADDR_2) == 3);
+  SIM_CHECK(place(&topology, 1, BENCH_MUX_1, 0, QT1244_ADDR_1) == 4);
+  SIM_CHECK(place(&topology, 1, TOPOLOGY_NO_MUX, 0, QT1244_ADDR_2) == 5);
+  // Direct keypad at an address already behind a mux
+  SIM_CHECK(place(&topology, 1, TOPOLOGY_NO_MUX, 0, QT1244_ADDR_1) < 0);
+
+  topology.plan();
+  simAdvance(2 * SIM_PERIOD_NS);
+
+  for (uint8_t s = 0; s < 4; s++) {
+    uint32_t keys[BENCH_KEYPADS];
+
+    SIM_CHECK(topology.scan(keys) == placed.size());
+    for (uint8_t n = 0; n < placed.size(); n++) {
+      SIM_CHECK(keys[n] == (1UL << n));
+    }
+  }
+  SIM_CHECK(collisions == 0);
+
+  benchReset();
+}
+
+/*
+	BENCH_KEYPADS keypads over controllers buses: four per controller sit
+	directly on it, more go behind a mux, four per channel.
+*/
+static void scaling(uint8_t controllers) {
+  QT1244Topology topology(&benchBus);
+  uint8_t perController = BENCH_KEYPADS / controllers;
+  uint32_t keys[BENCH_KEYPADS];
+  uint32_t wrong = 0;
+  uint64_t start, ns;
+
+  benchReset();
+
+  for (uint8_t c = 0; c < controllers; c++) {
+    for (uint8_t i = 0; i < perController; i++) {
+      uint8_t mux = (perController > 4) ? BENCH_MUX_1 : TOPOLOGY_NO_MUX;
+
+      SIM_CHECK(place(&topology, c, mux, i / 4, address[i % 4]) >= 0);
+    }
+  }
+  topology.plan();
+  simAdvance(2 * SIM_PERIOD_NS);
+
+  start = simBus.now;
+  muxWrites = 0;
+  for (uint16_t s = 0; s < BENCH_SCANS; s++) {
+    SIM_CHECK(topology.scan(keys) == BENCH_KEYPADS);
+    for (uint8_t n = 0; n < BENCH_KEYPADS; n++) {
+      wrong += (keys[n] != (1UL << n));
+    }
+  }
+  ns = simBus.now - start;
+
+  SIM_CHECK(wrong == 0);
+  SIM_CHECK(collisions == 0);
+
+  printf("%11u  %7u  %8.0f  %7.0f  %9.0f  %8.1f\n",
+         controllers, perController, ns / 1000.0 / BENCH_SCANS,
+         BENCH_SCANS * 1e9 / ns, BENCH_SCANS * 1e9 / ns * BENCH_KEYPADS * QT1244_KEYS,
+         (double)muxWrites / BENCH_SCANS);
+
+  benchReset();
+}
+
+int main(void) {
+  testCollisions();
+
+  printf("bench_topology: %u keypads, %u scans, %u ns per byte, %u ns per poll\n",
+         BENCH_KEYPADS, BENCH_SCANS, SIM_BYTE_NS, BENCH_POLL_NS);
+  printf("controllers  keypads   us/scan  scans/s     keys/s  mux/scan\n");
+
+  for (uint8_t controllers = 1; controllers <= TOPOLOGY_CONTROLLERS; controllers *= 2) {
+    scaling(controllers);
+  }
+
+  printf("bench_topology: %s\n", simFailures ? "FAILED" : "passed");
+
+  return simFailures ? 1 : 0;
+}
@@ -0,0 +1,27 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  Host stand-in for the application's delay.h: delays advance the simulated
+  clock of qt1244_sim.cpp instead of spinning.
+*******************************************************************************************************/
+#ifndef __DELAY_H
+#define __DELAY_H
+
+#include <stdint.h>
+
+void Delay_us(uint32_t us);
+
+#endif /* __DELAY_H */
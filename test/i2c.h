@@ -0,0 +1,66 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  Host stand-in for the application's i2c.h: the few STM32 HAL types and
+  calls the driver uses, and the QT1244 transport, all served by the
+  simulated devices of qt1244_sim.cpp.
+*******************************************************************************************************/
+#ifndef __I2C_H
+#define __I2C_H
+
+#include <stdint.h>
+
+
+typedef struct {
+	uint32_t pin;
+} GPIO_TypeDef;
+
+typedef enum {
+	GPIO_PIN_RESET = 0,
+	GPIO_PIN_SET
+} GPIO_PinState;
+
+typedef enum {
+	HAL_I2C_STATE_RESET = 0x00,
+	HAL_I2C_STATE_READY = 0x20
+} HAL_I2C_StateTypeDef;
+
+typedef struct {
+	HAL_I2C_StateTypeDef State;
+} I2C_HandleTypeDef;
+
+#define PWR_LOWPOWERREGULATOR_ON	0x00000001U
+#define PWR_STOPENTRY_WFI					((uint8_t)0x01)
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin);
+uint32_t HAL_GetTick(void);
+void HAL_SuspendTick(void);
+void HAL_ResumeTick(void);
+void HAL_PWR_EnterSTOPMode(uint32_t Regulator, uint8_t STOPEntry);
+void __disable_irq(void);
+void __enable_irq(void);
+
+I2C_HandleTypeDef qt1244Init(void);
+uint8_t qt1244Read(uint8_t devAddr, uint8_t regAddr);
+void qt1244Write(uint8_t devAddr, uint8_t regAddr, uint8_t data);
+void qt1244ReadBurst(uint8_t devAddr, uint8_t regAddr, uint8_t* data, uint16_t len);
+void qt1244WriteBurst(uint8_t devAddr, uint8_t regAddr, const uint8_t* data, uint16_t len);
+bool qt1244Ack(uint8_t devAddr);
+uint32_t qt1244PowerClock(void);
+void qt1244PowerResume(void);
+
+#endif /* __I2C_H */
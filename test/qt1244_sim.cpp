@@ -0,0 +1,452 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  Simulated AT42QT1244 and I2C bus for the host tests and benchmarks.
+*******************************************************************************************************/
+#include <string.h>
+#include "qt1244_sim.h"
+#include "qt1244.h"
+
+
+QT1244SimBus simBus;
+int simFailures = 0;
+
+QT1244Sim::QT1244Sim(uint8_t addr) {
+  this->addr = addr;
+  memset(mem, 0, sizeof(mem));
+  mem[CHIP_ID_ADDR] = SIM_CHIP_ID;
+  mem[VERSION_ADDR] = SIM_VERSION;
+  defaultSetups(&mem[SETUPS_ADDR]);
+  simSetupsCRC(&mem[SETUPS_ADDR]);
+
+  for (uint8_t k = 0; k < 24; k++) {
+    uint8_t* data = &mem[KEY_DATA_ADDR + k * KEY_DATA_SIZE];
+
+    data[KEY_DATA_SIGNAL] = SIM_REFERENCE & 0xFF;
+    data[KEY_DATA_SIGNAL + 1] = SIM_REFERENCE >> 8;
+    data[KEY_DATA_REFERENCE] = SIM_REFERENCE & 0xFF;
+    data[KEY_DATA_REFERENCE + 1] = SIM_REFERENCE >> 8;
+    COUNT[k] = 0;
+    CAL[k] = 0;
+  }
+
+  periodNs = SIM_PERIOD_NS;
+  nextNs = simBus.now + periodNs;
+  touch = 0;
+  noise = 0;
+  dropout = 0;
+  calFail = 0;
+  integrator = 1;
+  calCycles = 3;
+  strict = false;
+  crcNs = 0;
+  corruptSkip = 0;
+  corrupt = 0;
+  change = false;
+  cycles = 0;
+  protectedWrites = 0;
+  WRITEENABLE = false;
+  WRITTEN = 0;
+  PENDING = 0;
+  FAILED = 0;
+}
+
+void QT1244Sim::updateStatus(void) {
+  uint8_t setups[SETUPS_SIZE];
+
+  memcpy(setups, &mem[SETUPS_ADDR], SETUPS_SIZE);
+  simSetupsCRC(setups);
+
+  mem[STATUS_ADDR] = 0;
+  if ((memcmp(setups, &mem[SETUPS_ADDR], SETUPS_SIZE) != 0) || (simBus.now < WRITTEN + crcNs)) {
+    mem[STATUS_ADDR] |= STATUS_HCRC_ERROR;
+  }
+  if (calibrating()) {
+    mem[STATUS_ADDR] |= STATUS_CALIBRATING;
+  }
+}
+
+uint8_t QT1244Sim::read(uint8_t regAddr) {
+  if (regAddr == STATUS_ADDR) {
+    updateStatus();
+  }
+  if ((regAddr >= KEY_0TO7_ADDR) && (regAddr <= KEY_16TO23_ADDR)) {
+    change = false;
+  }
+
+  return mem[regAddr];
+}
+
+// Commands are taken at the start of the next cycle, like the real part
+void QT1244Sim::write(uint8_t regAddr, uint8_t data) {
+  if (regAddr == COMMAND_ADDR) {
+    if (data == SETUPS_WRITE_ENABLE) {
+      WRITEENABLE = true;
+      return;
+    }
+
+    commands.push_back(data);
+
+    if ((data == CALIBRATE_KEY_ALL) || (data == LOW_LEVEL_CAL_AND_OFFSET)) {
+      PENDING = 0x00FFFFFF;
+    }
+    else if (data <= CALIBRATE_KEY_23) {
+      PENDING |= 1UL << data;
+    }
+    else if (data == FORCE_RESET) {
+      WRITEENABLE = false;
+      PENDING = 0x00FFFFFF;
+      mem[KEY_0TO7_ADDR] = mem[KEY_8TO15_ADDR] = mem[KEY_16TO23_ADDR] = 0;
+    }
+  }
+  else if ((regAddr >= SETUPS_ADDR) && (regAddr < SETUPS_ADDR + SETUPS_SIZE)) {
+    if (WRITEENABLE) {
+      if (corruptSkip) {
+        corruptSkip--;
+      }
+      else if (corrupt) {
+        data ^= 0xFF;
+        corrupt--;
+      }
+      mem[regAddr] = data;
+      WRITTEN = simBus.now;
+    }
+    else {
+      protectedWrites++;
+    }
+  }
+}
+
+// Any read re-enables the write protection
+void QT1244Sim::endRead(void) {
+  WRITEENABLE = false;
+}
+
+void QT1244Sim::endWrite(void) {
+  if (strict) {
+    WRITEENABLE = false;
+  }
+}
+
+uint32_t QT1244Sim::detect(void) const {
+  return ((uint32_t)mem[KEY_16TO23_ADDR] << 16) | ((uint32_t)mem[KEY_8TO15_ADDR] << 8) | mem[KEY_0TO7_ADDR];
+}
+
+bool QT1244Sim::calibrating(void) const {
+  for (uint8_t k = 0; k < 24; k++) {
+    if (CAL[k]) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/*
+	One acquisition cycle: start pending calibrations, integrate the
+	touches, publish the detect status and raise CHANGE if it moved.
+*/
+void QT1244Sim::cycle(void) {
+  uint32_t before = detect();
+  uint32_t after = 0;
+
+  cycles++;
+
+  for (uint8_t k = 0; k < 24; k++) {
+    uint32_t bit = 1UL << k;
+    uint8_t* data = &mem[KEY_DATA_ADDR + k * KEY_DATA_SIZE];
+    bool touched = (touch & bit) && !(dropout & bit);
+    uint16_t signal = SIM_REFERENCE;
+
+    if (PENDING & bit) {
+      CAL[k] = calCycles;
+      COUNT[k] = 0;
+    }
+
+    if (CAL[k]) {
+      if (--CAL[k] == 0) {
+        FAILED = (calFail & bit) ? (FAILED | bit) : (FAILED & ~bit);
+      }
+      data[KEY_DATA_STATUS] = CAL[k] ? KEY_STATUS_CALIBRATING : ((FAILED & bit) ? KEY_STATUS_CAL_FAIL : 0);
+    }
+    else {
+      COUNT[k] = touched ? ((COUNT[k] < 255) ? COUNT[k] + 1 : 255) : 0;
+
+      if ((COUNT[k] >= integrator) || (noise & bit)) {
+        after |= bit;
+      }
+      if (touched) {
+        signal -= SIM_DELTA;
+      }
+      data[KEY_DATA_STATUS] = (FAILED & bit) ? KEY_STATUS_CAL_FAIL : 0;
+    }
+
+    data[KEY_DATA_SIGNAL] = signal & 0xFF;
+    data[KEY_DATA_SIGNAL + 1] = signal >> 8;
+  }
+
+  PENDING = 0;
+  noise = 0;
+  dropout = 0;
+
+  mem[KEY_0TO7_ADDR] = after & 0xFF;
+  mem[KEY_8TO15_ADDR] = (after >> 8) & 0xFF;
+  mem[KEY_16TO23_ADDR] = (after >> 16) & 0xFF;
+
+  if (after != before) {
+    change = true;
+  }
+}
+
+
+void simReset(void) {
+  simBus.devices.clear();
+  simBus.now = 0;
+  simBus.byteNs = SIM_BYTE_NS;
+  simBus.transactions = 0;
+  simBus.bytes = 0;
+  simBus.log = false;
+  simBus.transfers.clear();
+  simBus.pin = 0;
+  simBus.stop = 0;
+  simBus.cycled = 0;
+  simBus.resumes = 0;
+  simBus.masked = false;
+  simBus.maskedTransfers = 0;
+}
+
+void simAttach(QT1244Sim* dev) {
+  dev->nextNs = simBus.now + dev->periodNs;
+  simBus.devices.push_back(dev);
+}
+
+// Time of the next cycle of any device
+uint64_t simNextCycle(void) {
+  uint64_t next = ~0ULL;
+
+  for (size_t i = 0; i < simBus.devices.size(); i++) {
+    if (simBus.devices[i]->nextNs < next) {
+      next = simBus.devices[i]->nextNs;
+    }
+  }
+
+  return next;
+}
+
+void simRunUntil(uint64_t ns) {
+  for (;;) {
+    uint64_t next = simNextCycle();
+
+    if (next > ns) {
+      break;
+    }
+
+    simBus.now = next;
+    for (size_t i = 0; i < simBus.devices.size(); i++) {
+      QT1244Sim* dev = simBus.devices[i];
+
+      if (dev->nextNs == next) {
+        dev->cycle();
+        dev->nextNs += dev->periodNs;
+        if (simBus.cycled) {
+          simBus.cycled(dev);
+        }
+      }
+    }
+  }
+
+  if (ns > simBus.now) {
+    simBus.now = ns;
+  }
+}
+
+void simAdvance(uint64_t ns) {
+  simRunUntil(simBus.now + ns);
+}
+
+QT1244Sim* simFind(uint8_t addr) {
+  for (size_t i = 0; i < simBus.devices.size(); i++) {
+    if (simBus.devices[i]->addr == addr) {
+      return simBus.devices[i];
+    }
+  }
+
+  return 0;
+}
+
+// Independent of the driver's setupsCRC(), so the tests check it
+void simSetupsCRC(uint8_t* setups) {
+  uint16_t crc = 0;
+
+  for (uint8_t i = 0; i < HCRClsb_ADDR - SETUPS_ADDR; i++) {
+    crc ^= (uint16_t)setups[i] << 8;
+    for (uint8_t b = 0; b < 8; b++) {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+
+  setups[HCRClsb_ADDR - SETUPS_ADDR] = crc & 0xFF;
+  setups[HCRCmsb_ADDR - SETUPS_ADDR] = crc >> 8;
+}
+
+
+/*
+	Transport. The driver passes addresses shifted left for the STM32 HAL.
+	Cost: address, register, (repeated start and address,) data bytes.
+*/
+static QT1244Sim* transfer(bool write, uint8_t devAddr, uint8_t regAddr, uint16_t len) {
+  uint16_t bytes = write ? 2 + len : 3 + len;
+
+  simBus.transactions++;
+  simBus.bytes += bytes;
+  simBus.maskedTransfers += simBus.masked;
+  if (simBus.log) {
+    SimTransfer t = { write, (uint8_t)(devAddr >> 1), regAddr, len };
+    simBus.transfers.push_back(t);
+  }
+  simAdvance((uint64_t)bytes * simBus.byteNs);
+
+  return simFind(devAddr >> 1);
+}
+
+uint8_t qt1244Read(uint8_t devAddr, uint8_t regAddr) {
+  QT1244Sim* dev = transfer(false, devAddr, regAddr, 1);
+  uint8_t data = 0xFF;
+
+  if (dev) {
+    data = dev->read(regAddr);
+    dev->endRead();
+  }
+
+  return data;
+}
+
+void qt1244Write(uint8_t devAddr, uint8_t regAddr, uint8_t data) {
+  QT1244Sim* dev = transfer(true, devAddr, regAddr, 1);
+
+  if (dev) {
+    dev->write(regAddr, data);
+    dev->endWrite();
+  }
+}
+
+void qt1244ReadBurst(uint8_t devAddr, uint8_t regAddr, uint8_t* data, uint16_t len) {
+  QT1244Sim* dev = transfer(false, devAddr, regAddr, len);
+
+  for (uint16_t i = 0; i < len; i++) {
+    data[i] = dev ? dev->read(regAddr + i) : 0xFF;
+  }
+  if (dev) {
+    dev->endRead();
+  }
+}
+
+void qt1244WriteBurst(uint8_t devAddr, uint8_t regAddr, const uint8_t* data, uint16_t len) {
+  QT1244Sim* dev = transfer(true, devAddr, regAddr, len);
+
+  if (dev) {
+    for (uint16_t i = 0; i < len; i++) {
+      dev->write(regAddr + i, data[i]);
+    }
+    dev->endWrite();
+  }
+}
+
+bool qt1244Ack(uint8_t devAddr) {
+  simBus.transactions++;
+  simBus.bytes++;
+  simBus.maskedTransfers += simBus.masked;
+  simAdvance(simBus.byteNs);
+
+  return simFind(devAddr >> 1) != 0;
+}
+
+I2C_HandleTypeDef qt1244Init(void) {
+  I2C_HandleTypeDef hi2c;
+
+  hi2c.State = HAL_I2C_STATE_READY;
+
+  return hi2c;
+}
+
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState) {
+  (void)GPIOx;
+  (void)GPIO_Pin;
+  (void)PinState;
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin) {
+  (void)GPIOx;
+
+  if (simBus.pin) {
+    return simBus.pin(GPIO_Pin);
+  }
+  if (!simBus.devices.empty() && simBus.devices[0]->change) {
+    return GPIO_PIN_RESET;
+  }
+
+  return GPIO_PIN_SET;
+}
+
+uint32_t HAL_GetTick(void) {
+  return (uint32_t)(simBus.now / 1000000);
+}
+
+void HAL_SuspendTick(void) {
+}
+
+void HAL_ResumeTick(void) {
+}
+
+/*
+	Sleep until the CHANGE line of the first device falls, unless the test
+	supplies its own wake-up.
+*/
+void HAL_PWR_EnterSTOPMode(uint32_t Regulator, uint8_t STOPEntry) {
+  (void)Regulator;
+  (void)STOPEntry;
+
+  if (simBus.stop) {
+    simBus.stop();
+    return;
+  }
+
+  while (!simBus.devices.empty() && !simBus.devices[0]->change) {
+    simRunUntil(simNextCycle());
+  }
+}
+
+void __disable_irq(void) {
+  simBus.masked = true;
+}
+
+void __enable_irq(void) {
+  simBus.masked = false;
+}
+
+uint32_t qt1244PowerClock(void) {
+  return (uint32_t)(simBus.now / 1000);
+}
+
+void qt1244PowerResume(void) {
+  simBus.resumes++;
+  simAdvance(50000);
+}
+
+void Delay_us(uint32_t us) {
+  simAdvance((uint64_t)us * 1000);
+}
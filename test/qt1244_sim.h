@@ -0,0 +1,144 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  Simulated AT42QT1244 and I2C bus for the host tests and benchmarks.
+  The device keeps the memory map, the setups write protection, the HCRC
+  check, calibration and the CHANGE line; touches are turned into detect
+  status once per acquisition cycle. All time is simulated: every bus
+  transaction and delay advances one clock, and the devices run their
+  cycles as the clock passes them.
+*******************************************************************************************************/
+#ifndef __QT1244_SIM_H
+#define __QT1244_SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include "i2c.h"
+
+
+#define SIM_CHIP_ID       0x41
+#define SIM_VERSION       0x10
+#define SIM_PERIOD_NS     16000000ULL	// Acquisition cycle
+#define SIM_BYTE_NS       22500				// One byte + ACK at 400 kHz
+#define SIM_REFERENCE     0x0200
+#define SIM_DELTA         40					// Signal drop of a touched key
+
+
+class QT1244Sim {
+	public:
+		QT1244Sim(uint8_t addr);
+
+		// Bus side, one byte at a time
+		uint8_t read(uint8_t regAddr);
+		void write(uint8_t regAddr, uint8_t data);
+		void endRead(void);
+		void endWrite(void);
+
+		// Device side
+		void cycle(void);
+		uint32_t detect(void) const;
+		bool calibrating(void) const;
+
+		uint8_t addr;							// 7 bits
+		uint8_t mem[256];
+		uint64_t periodNs;
+		uint64_t nextNs;
+
+		uint32_t touch;						// Physical touches, bit k for key k
+		uint32_t noise;						// Keys falsely detected for the next cycle
+		uint32_t dropout;					// Touched keys missed for the next cycle
+		uint32_t calFail;					// Keys failing their next calibration
+		uint8_t integrator;				// Cycles a touch must last to be detected
+		uint8_t calCycles;				// Cycles a calibration lasts
+		bool strict;							// Write-enable only lasts one transaction
+		uint64_t crcNs;						// HCRC reads as an error this long after a setups write
+		uint32_t corruptSkip;			// Setups bytes written normally before corrupt takes effect
+		uint32_t corrupt;					// Setups bytes then stored inverted
+
+		bool change;							// CHANGE asserted (pin low)
+		uint32_t cycles;
+		uint32_t protectedWrites;	// Setups bytes written while write protected
+		std::vector<uint8_t> commands;
+
+	private:
+		bool WRITEENABLE;
+		uint64_t WRITTEN;					// Time of the last setups write
+		uint32_t PENDING;					// Keys to start calibrating next cycle
+		uint32_t FAILED;
+		uint8_t COUNT[24];
+		uint8_t CAL[24];
+
+		void updateStatus(void);
+};
+
+
+typedef struct {
+	bool write;
+	uint8_t addr;
+	uint8_t regAddr;
+	uint16_t len;
+} SimTransfer;
+
+/*
+	The bus and simulated time. pin, when set, answers HAL_GPIO_ReadPin();
+	by default the pin is the CHANGE line of the first device. stop is run
+	by HAL_PWR_EnterSTOPMode(). cycled, when set, runs after every device
+	cycle, before the next one is due, to follow or drive the touches or
+	the key data. A transaction with interrupts masked would never time
+	out on real hardware; maskedTransfers counts them.
+*/
+struct QT1244SimBus {
+	std::vector<QT1244Sim*> devices;
+	uint64_t now;							// ns
+	uint32_t byteNs;
+	uint32_t transactions;
+	uint32_t bytes;
+	bool log;
+	std::vector<SimTransfer> transfers;
+	GPIO_PinState (*pin)(uint16_t GPIO_Pin);
+	void (*stop)(void);
+	void (*cycled)(QT1244Sim* dev);
+	uint32_t resumes;
+	bool masked;							// Between __disable_irq() and __enable_irq()
+	uint32_t maskedTransfers;	// Bus transactions with interrupts masked
+};
+
+extern QT1244SimBus simBus;
+
+/*
+	Test checks: report the failing condition and keep going, main()
+	returns simFailures.
+*/
+extern int simFailures;
+
+#define SIM_CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			simFailures++; \
+		} \
+	} while (0)
+
+void simReset(void);
+void simAttach(QT1244Sim* dev);
+void simAdvance(uint64_t ns);
+void simRunUntil(uint64_t ns);
+QT1244Sim* simFind(uint8_t addr);
+uint64_t simNextCycle(void);
+void simSetupsCRC(uint8_t* setups);
+
+#endif /* __QT1244_SIM_H */
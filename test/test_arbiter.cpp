@@ -0,0 +1,210 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  QT1244Arbiter tests on the simulated bus: priority order, preemption
+  between the chunks of a bulk transfer, per-client occupancy statistics,
+  and a QT1244 attached to the arbiter uploading its setups to a device
+  whose write-enable only lasts one write.
+*******************************************************************************************************/
+#include <string.h>
+#include <string>
+#include "qt1244.h"
+#include "qt1244_arbiter.h"
+#include "qt1244_sim.h"
+
+
+#define CLIENT_QT1244     0
+#define CLIENT_SENSOR     1
+#define CLIENT_EEPROM     2
+
+static std::string order;
+
+static uint32_t clockUs(void) {
+  return (uint32_t)(simBus.now / 1000);
+}
+
+// Other peripherals: the chunk takes its bytes on the wire, and is logged by its tag
+static bool tagged(ArbiterTransfer* t, uint16_t offset, uint16_t len) {
+  (void)offset;
+  order += (char)t->regAddr;
+  simAdvance((uint64_t)(2 + len) * SIM_BYTE_NS);
+
+  return true;
+}
+
+static void transfer(ArbiterTransfer* t, uint8_t client, uint8_t priority, char tag, uint16_t len) {
+  static uint8_t data[256];
+
+  memset(t, 0, sizeof(*t));
+  t->client = client;
+  t->priority = priority;
+  t->devAddr = 0x50 << 1;
+  t->regAddr = tag;
+  t->data = data;
+  t->len = len;
+  t->write = true;
+  t->xfer = tagged;
+}
+
+static void drain(QT1244Arbiter* bus) {
+  while (bus->poll()) {
+  }
+}
+
+static void testOrder(void) {
+  QT1244Arbiter bus(clockUs);
+  ArbiterTransfer bulk, config, keys;
+
+  simReset();
+  order.clear();
+
+  transfer(&bulk, CLIENT_EEPROM, ARBITER_PRIORITY_BULK, 'B', 2 * ARBITER_CHUNK_SIZE);
+  transfer(&config, CLIENT_SENSOR, ARBITER_PRIORITY_CONFIG, 'C', 8);
+  transfer(&keys, CLIENT_QT1244, ARBITER_PRIORITY_KEYS, 'K', 4 * ARBITER_CHUNK_SIZE);
+  SIM_CHECK(bus.submit(&bulk) && bus.submit(&config) && bus.submit(&keys));
+  drain(&bus);
+
+  // Key reads are never chunked
+  SIM_CHECK(order == "KCBB");
+  SIM_CHECK((bulk.state == ARBITER_DONE) && (config.state == ARBITER_DONE) && (keys.state == ARBITER_DONE));
+}
+
+static void testPreemption(void) {
+  QT1244Arbiter bus(clockUs);
+  ArbiterTransfer bulk, config, keys, whole;
+
+  simReset();
+  order.clear();
+
+  transfer(&bulk, CLIENT_EEPROM, ARBITER_PRIORITY_BULK, 'B', 4 * ARBITER_CHUNK_SIZE);
+  SIM_CHECK(bus.submit(&bulk));
+  SIM_CHECK(bus.poll());
+
+  // Arrive while the bulk transfer is between chunks
+  transfer(&keys, CLIENT_QT1244, ARBITER_PRIORITY_KEYS, 'K', 3);
+  transfer(&config, CLIENT_SENSOR, ARBITER_PRIORITY_CONFIG, 'C', ARBITER_CHUNK_SIZE + 4);
+  SIM_CHECK(bus.submit(&config) && bus.submit(&keys));
+  drain(&bus);
+  SIM_CHECK(order == "BKCCBBB");
+
+  // A whole transfer is one transaction, however long
+  order.clear();
+  transfer(&whole, CLIENT_SENSOR, ARBITER_PRIORITY_CONFIG, 'W', 4 * ARBITER_CHUNK_SIZE);
+  whole.whole = true;
+  SIM_CHECK(bus.run(&whole));
+  SIM_CHECK(order == "W");
+}
+
+static void testStats(void) {
+  QT1244Arbiter bus(clockUs);
+  ArbiterTransfer bulk, keys;
+  const ArbiterStats* s;
+  uint32_t chunkUs = (2 + ARBITER_CHUNK_SIZE) * SIM_BYTE_NS / 1000;
+
+  simReset();
+  simAdvance(1000000);
+  bus.resetStats();
+
+  transfer(&bulk, CLIENT_EEPROM, ARBITER_PRIORITY_BULK, 'B', 4 * ARBITER_CHUNK_SIZE);
+  SIM_CHECK(bus.submit(&bulk));
+  SIM_CHECK(bus.poll());
+  transfer(&keys, CLIENT_QT1244, ARBITER_PRIORITY_KEYS, 'K', 4);
+  SIM_CHECK(bus.submit(&keys));
+  drain(&bus);
+  simAdvance(10000000);
+
+  s = bus.stats(CLIENT_EEPROM);
+  SIM_CHECK((s->transfers == 1) && (s->bytes == 4 * ARBITER_CHUNK_SIZE));
+  SIM_CHECK((s->busy >= 4 * chunkUs) && (s->busy <= 4 * chunkUs + 4));
+  SIM_CHECK(s->maxWait == 0);
+
+  s = bus.stats(CLIENT_QT1244);
+  SIM_CHECK((s->transfers == 1) && (s->bytes == 4));
+  SIM_CHECK((s->busy >= (2 + 4) * SIM_BYTE_NS / 1000) && (s->busy <= (2 + 4) * SIM_BYTE_NS / 1000 + 1));
+
+  s = bus.stats(CLIENT_SENSOR);
+  SIM_CHECK((s->transfers == 0) && (s->bytes == 0) && (s->busy == 0));
+  SIM_CHECK(bus.stats(ARBITER_CLIENTS) == 0);
+
+  printf("occupancy over %u us: eeprom %.2f%%, qt1244 %.2f%%\n", bus.elapsed(),
+         100.0 * bus.stats(CLIENT_EEPROM)->busy / bus.elapsed(), 100.0 * bus.stats(CLIENT_QT1244)->busy / bus.elapsed());
+  SIM_CHECK(bus.elapsed() >= 10000);
+
+  bus.resetStats();
+  SIM_CHECK(bus.stats(CLIENT_EEPROM)->transfers == 0);
+}
+
+/*
+	A field change through the arbiter: the shadow read is chunked, the
+	upload is one write from COMMAND_ADDR, and the memory map dump of
+	debug() is chunked like any configuration read.
+*/
+static void testSetups(void) {
+  QT1244Arbiter bus(clockUs);
+  QT1244Sim sim(QT1244_ADDR_1);
+  QT1244 dev;
+  uint32_t writes = 0;
+  size_t from;
+  char report[1024];
+
+  simReset();
+  simAttach(&sim);
+  sim.strict = true;
+  simBus.log = true;
+  dev.arbiter(&bus, CLIENT_QT1244);
+  SIM_CHECK(dev.begin(QT1244_ADDR_1));
+
+  from = simBus.transfers.size();
+  SIM_CHECK(dev.set<NTHR_FIELD>(5, 2));
+  for (size_t i = from; i < simBus.transfers.size(); i++) {
+    const SimTransfer* t = &simBus.transfers[i];
+
+    if (t->write) {
+      SIM_CHECK((t->regAddr == COMMAND_ADDR) && (t->len == HCRCmsb_ADDR - COMMAND_ADDR + 1));
+      writes++;
+    }
+    else {
+      SIM_CHECK(t->len <= ARBITER_CHUNK_SIZE);
+    }
+  }
+  SIM_CHECK(writes == 1);
+  SIM_CHECK(NTHR_FIELD::get(sim.mem[NTHR_FIELD::addr + 5]) == 2);
+
+  simAdvance(SIM_PERIOD_NS);
+  sim.read(STATUS_ADDR);
+  SIM_CHECK(!(sim.mem[STATUS_ADDR] & STATUS_HCRC_ERROR));
+  SIM_CHECK(sim.protectedWrites == 0);
+
+  from = simBus.transfers.size();
+  dev.debug(report, sizeof(report));
+  SIM_CHECK(simBus.transfers.size() - from == (MEMORY_MAP_SIZE + ARBITER_CHUNK_SIZE - 1) / ARBITER_CHUNK_SIZE);
+  for (size_t i = from; i < simBus.transfers.size(); i++) {
+    SIM_CHECK(simBus.transfers[i].len <= ARBITER_CHUNK_SIZE);
+  }
+
+  simBus.log = false;
+}
+
+int main(void) {
+  testOrder();
+  testPreemption();
+  testStats();
+  testSetups();
+
+  printf("test_arbiter: %s\n", simFailures ? "FAILED" : "passed");
+
+  return simFailures ? 1 : 0;
+}
@@ -0,0 +1,190 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  QT1244Loop tests against an instant transport that can fail a chosen
+  transfer: the device operations report the failure instead of returning
+  what the buffer held, and a QT1244 object sharing the device with
+  asyncSetups() picks up the new setups after invalidateShadow().
+*******************************************************************************************************/
+#include <string.h>
+#include "qt1244_coro.h"
+#include "qt1244_sim.h"
+
+
+#define CORO_TOUCH        0x000005
+
+static uint32_t started;
+static uint32_t failAt;					// Transfer number to fail, 0 for none
+static bool failed;
+
+// The bytes move at once; a failed read leaves garbage in the buffer
+static bool coroStart(uint8_t bus, bool write, uint8_t devAddr, uint8_t regAddr, uint8_t* data, uint16_t len) {
+  QT1244Sim* dev = simFind(devAddr >> 1);
+
+  (void)bus;
+  if (!dev) {
+    return false;
+  }
+
+  simAdvance((write ? 2 + len : 3 + len) * SIM_BYTE_NS);
+  failed = (++started == failAt);
+
+  for (uint16_t i = 0; i < len; i++) {
+    if (failed && !write) {
+      data[i] = 0xA5;
+    }
+    else if (write) {
+      dev->write(regAddr + i, data[i]);
+    }
+    else {
+      data[i] = dev->read(regAddr + i);
+    }
+  }
+  if (write) {
+    dev->endWrite();
+  }
+  else {
+    dev->endRead();
+  }
+
+  return true;
+}
+
+static bool coroBusy(uint8_t bus) {
+  (void)bus;
+  return false;
+}
+
+static bool coroError(uint8_t bus) {
+  (void)bus;
+  return failed;
+}
+
+static const QT1244AsyncBus coroTransport = { coroStart, coroBusy, coroError };
+static const QT1244AsyncBus blindTransport = { coroStart, coroBusy, 0 };
+
+static const QT1244AsyncDevice coroDev = { 0, QT1244_ADDR_1 };
+
+static void run(const QT1244AsyncBus* transport, QT1244Task<void> (*test)(QT1244Loop&)) {
+  QT1244Loop loop(transport);
+
+  started = 0;
+  failAt = 0;
+  failed = false;
+  loop.spawn(test(loop));
+  loop.run();
+}
+
+static QT1244Task<void> errors(QT1244Loop& loop) {
+  uint8_t data[QT1244_KEYS * KEY_DATA_SIZE];
+  uint32_t keys = 0x123;
+
+  failAt = started + 1;
+  SIM_CHECK(!co_await asyncSnapshot(loop, coroDev, &keys));
+  SIM_CHECK(keys == 0x123);
+  SIM_CHECK(co_await asyncSnapshot(loop, coroDev, &keys));
+  SIM_CHECK(keys == CORO_TOUCH);
+
+  failAt = started + 1;
+  SIM_CHECK(!co_await asyncKeyData(loop, coroDev, data));
+
+  // The block write, then the status read
+  failAt = started + 1;
+  SIM_CHECK(!co_await asyncSetups(loop, coroDev, 0));
+  failAt = started + 2;
+  SIM_CHECK(!co_await asyncSetups(loop, coroDev, 0));
+  SIM_CHECK(co_await asyncSetups(loop, coroDev, 0));
+}
+
+// A transport without error() counts every transfer it finished as done
+static QT1244Task<void> blind(QT1244Loop& loop) {
+  uint32_t keys = 0;
+
+  failAt = started + 1;
+  SIM_CHECK(co_await asyncSnapshot(loop, coroDev, &keys));
+  SIM_CHECK(keys == 0xA5A5A5);
+}
+
+static void testErrors(void) {
+  QT1244Sim sim(QT1244_ADDR_1);
+
+  simReset();
+  simAttach(&sim);
+  sim.touch = CORO_TOUCH;
+  simAdvance(4 * SIM_PERIOD_NS);
+
+  run(&coroTransport, errors);
+  run(&blindTransport, blind);
+  SIM_CHECK(sim.protectedWrites == 0);
+}
+
+static void profileImage(uint8_t* image, uint8_t nthr) {
+  defaultSetups(image);
+  image[0] = (image[0] & ~NTHR_FIELD::mask) | NTHR_FIELD::put(nthr);
+  setupsCRC(image);
+}
+
+static uint8_t other[SETUPS_SIZE];
+
+static QT1244Task<void> upload(QT1244Loop& loop) {
+  bool ok = co_await asyncSetups(loop, coroDev, other);
+
+  SIM_CHECK(ok);
+}
+
+static void testShadow(void) {
+  QT1244Sim sim(QT1244_ADDR_1);
+  QT1244 dev;
+  uint8_t image[SETUPS_SIZE];
+
+  simReset();
+  simAttach(&sim);
+  SIM_CHECK(dev.begin(QT1244_ADDR_1));
+
+  profileImage(image, 2);
+  profileImage(other, 5);
+  SIM_CHECK(dev.switchProfile(image));
+
+  // The shadow still holds image, so switching back writes nothing
+  run(&coroTransport, upload);
+  SIM_CHECK(memcmp(&sim.mem[SETUPS_ADDR], other, SETUPS_SIZE) == 0);
+  SIM_CHECK(dev.switchProfile(image));
+  SIM_CHECK(memcmp(&sim.mem[SETUPS_ADDR], other, SETUPS_SIZE) == 0);
+
+  dev.invalidateShadow();
+  SIM_CHECK(dev.switchProfile(image));
+  SIM_CHECK(memcmp(&sim.mem[SETUPS_ADDR], image, SETUPS_SIZE) == 0);
+
+  // set<Field>() reads the block back before changing one key
+  run(&coroTransport, upload);
+  dev.invalidateShadow();
+  SIM_CHECK(dev.set<NTHR_FIELD>(3, 7));
+  SIM_CHECK(NTHR_FIELD::get(sim.mem[NTHR_FIELD::addr + 3]) == 7);
+  SIM_CHECK(NTHR_FIELD::get(sim.mem[NTHR_FIELD::addr]) == 5);
+
+  sim.read(STATUS_ADDR);
+  SIM_CHECK(!(sim.mem[STATUS_ADDR] & STATUS_HCRC_ERROR));
+  SIM_CHECK(sim.protectedWrites == 0);
+}
+
+int main(void) {
+  testErrors();
+  testShadow();
+
+  printf("test_coro: %s\n", simFailures ? "FAILED" : "passed");
+
+  return simFailures ? 1 : 0;
+}
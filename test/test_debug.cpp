@@ -0,0 +1,128 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  debug() tests against a simulated device with known differences from the
+  expected setups: the diff entries, the decoded 11-bit LSL and a per-key
+  field listed key by key. Every shorter buffer gets a prefix of the full
+  report cut between two items and ending with "...\n".
+*******************************************************************************************************/
+#include <string.h>
+#include "qt1244.h"
+#include "qt1244_sim.h"
+
+
+#define DEBUG_LSL         1000
+#define DEBUG_KEY         2
+
+static bool has(const char* report, const char* text) {
+  return strstr(report, text) != 0;
+}
+
+static void testReport(QT1244& dev, QT1244Sim& sim, char* full) {
+  uint8_t defaults[SETUPS_SIZE];
+  uint8_t nthr = NTHR_PTHR_NDRIFT_BL_ADDR + DEBUG_KEY;
+  char text[64];
+  uint16_t len;
+
+  defaultSetups(defaults);
+
+  // LSL 1000 = 0x3E8 over two registers, and NTHR 7 on one key
+  sim.mem[LSLlsb_ADDR] = DEBUG_LSL & 0xFF;
+  sim.mem[LSLmsb_KGTT_ADDR] = (sim.mem[LSLmsb_KGTT_ADDR] & ~LSLmsb_FIELD::mask) | LSLmsb_FIELD::put(DEBUG_LSL >> 8);
+  sim.mem[nthr] = (sim.mem[nthr] & ~NTHR_FIELD::mask) | NTHR_FIELD::put(7);
+
+  len = dev.debug(full, 1024);
+  printf("%s", full);
+  SIM_CHECK(len == strlen(full));
+  SIM_CHECK(full[len - 1] == '\n');
+
+  snprintf(text, sizeof(text), "id=%02X ver=%02X ", SIM_CHIP_ID, SIM_VERSION);
+  SIM_CHECK(strncmp(full, text, strlen(text)) == 0);
+
+  snprintf(text, sizeof(text), "diff %u:%02X/%02X %u:%02X/%02X %u:%02X/%02X\n",
+           nthr, sim.mem[nthr], defaults[nthr - SETUPS_ADDR],
+           LSLlsb_ADDR, sim.mem[LSLlsb_ADDR], defaults[LSLlsb_ADDR - SETUPS_ADDR],
+           LSLmsb_KGTT_ADDR, sim.mem[LSLmsb_KGTT_ADDR], defaults[LSLmsb_KGTT_ADDR - SETUPS_ADDR]);
+  SIM_CHECK(has(full, text));
+
+  SIM_CHECK(has(full, " LSL=1000 "));
+  SIM_CHECK(has(full, "NIL=3\n"));
+  SIM_CHECK(!has(full, "LSLlsb") && !has(full, "LSLmsb"));
+
+  snprintf(text, sizeof(text), "\nNTHR=%u,%u,7,%u,", NTHR_PTHR_VALUE, NTHR_PTHR_VALUE, NTHR_PTHR_VALUE);
+  SIM_CHECK(has(full, text));
+  SIM_CHECK(!has(full, " NTHR="));
+  SIM_CHECK(!has(full, "..."));
+}
+
+// Item ends: the first line is one item, then before the space, comma or line end that starts the next
+static bool boundary(const char* full, uint16_t p) {
+  uint16_t first = strchr(full, '\n') - full;
+
+  if (p <= first) {
+    return p == 0;
+  }
+  return (full[p - 1] == '\n') || strchr(" ,\n", full[p]);
+}
+
+static void testCut(QT1244& dev, const char* full) {
+  uint16_t fullLen = strlen(full);
+  char report[1024];
+
+  for (uint16_t size = 1; size <= fullLen + 1; size++) {
+    uint16_t len = dev.debug(report, size);
+
+    SIM_CHECK((len < size) && (len == strlen(report)));
+
+    if (size == fullLen + 1) {
+      SIM_CHECK(strcmp(report, full) == 0);
+    }
+    else if (size < sizeof("...\n")) {
+      SIM_CHECK(len == 0);
+    }
+    else {
+      uint16_t p = len - strlen("...\n");
+      uint16_t q = p + 1;
+
+      SIM_CHECK(strcmp(&report[p], "...\n") == 0);
+      SIM_CHECK(strncmp(report, full, p) == 0);
+      SIM_CHECK(boundary(full, p));
+
+      // The next item would not have left room for the marker
+      while ((q < fullLen) && !boundary(full, q)) {
+        q++;
+      }
+      SIM_CHECK(q + sizeof("...\n") > size);
+    }
+  }
+}
+
+int main(void) {
+  QT1244Sim sim(QT1244_ADDR_1);
+  QT1244 dev;
+  char full[1024];
+
+  simReset();
+  simAttach(&sim);
+  SIM_CHECK(dev.begin(QT1244_ADDR_1));
+
+  testReport(dev, sim, full);
+  testCut(dev, full);
+
+  printf("test_debug: %s\n", simFailures ? "FAILED" : "passed");
+
+  return simFailures ? 1 : 0;
+}
@@ -0,0 +1,64 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  Host STOP-mode idle tests (QT1244_POWER): the wake read returns the new
+  detect status, and no bus transaction runs with interrupts masked.
+*******************************************************************************************************/
+#include "qt1244.h"
+#include "qt1244_sim.h"
+
+
+static GPIO_TypeDef changePort;
+
+static void testIdle(void) {
+  QT1244Sim sim(QT1244_ADDR_1);
+  QT1244 dev;
+  QT1244PowerStats stats;
+
+  simReset();
+  simAttach(&sim);
+  SIM_CHECK(dev.begin(QT1244_ADDR_1));
+
+  // Asleep until the touch reaches the detect status
+  sim.touch = 1UL << 7;
+  SIM_CHECK(dev.powerIdle(&changePort, 0) == (1UL << 7));
+  SIM_CHECK(simBus.resumes == 1);
+  SIM_CHECK(!sim.change);
+
+  // CHANGE already low: read at once, no STOP
+  sim.touch = 0;
+  simAdvance(SIM_PERIOD_NS);
+  SIM_CHECK(sim.change);
+  SIM_CHECK(dev.powerIdle(&changePort, 0) == 0);
+  SIM_CHECK(simBus.resumes == 1);
+
+  SIM_CHECK(simBus.maskedTransfers == 0);
+  SIM_CHECK(!simBus.masked);
+
+  dev.powerStats(&stats);
+  printf("powerIdle: %u wakes, latency max %u us, %u overruns\n", stats.wakes, stats.latencyMax, stats.overruns);
+  SIM_CHECK(stats.wakes == 1);
+  SIM_CHECK(stats.overruns == 0);
+  SIM_CHECK(stats.sleepUs > 0);
+}
+
+int main(void) {
+  testIdle();
+
+  printf("test_power: %s\n", simFailures ? "FAILED" : "passed");
+
+  return simFailures ? 1 : 0;
+}
@@ -0,0 +1,204 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  QT1244Queue tests: the coalescing rules of drain() on a fixed command
+  sequence, then a std::thread stress run with several producers posting
+  against one draining driver thread, checking every token and result.
+*******************************************************************************************************/
+#include <atomic>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include "qt1244_queue.h"
+#include "qt1244_sim.h"
+
+
+#define STRESS_PRODUCERS    4
+#define STRESS_POSTS        20000
+#define STRESS_TOKENS       8
+#define TOUCHED_KEY         5
+
+static void testCoalescing(void) {
+  QT1244Sim sim(QT1244_ADDR_1);
+  QT1244 dev;
+  QT1244Queue queue(&dev, 0);
+  QueueToken token[9];
+
+  simReset();
+  simAttach(&sim);
+  SIM_CHECK(dev.begin(QT1244_ADDR_1));
+  sim.touch = 1UL << TOUCHED_KEY;
+  simAdvance(SIM_PERIOD_NS);
+
+  SIM_CHECK(queue.post(QUEUE_CMD_CALIBRATE_KEY, 3, &token[0]));
+  SIM_CHECK(queue.post(QUEUE_CMD_CALIBRATE_KEY, 3, &token[1]));
+  SIM_CHECK(queue.post(QUEUE_CMD_SCAN, 0, &token[2]));
+  SIM_CHECK(queue.post(QUEUE_CMD_SCAN, 0, &token[3]));
+  SIM_CHECK(queue.post(QUEUE_CMD_CALIBRATE_KEY, 3, &token[4]));
+  SIM_CHECK(queue.post(QUEUE_CMD_RESET, 0, &token[5]));
+  SIM_CHECK(queue.post(QUEUE_CMD_CALIBRATE_KEY, 3, &token[6]));
+  SIM_CHECK(queue.post(QUEUE_CMD_CALIBRATE_KEY, 30, &token[7]));
+  SIM_CHECK(queue.post(QUEUE_CMD_SCAN, 0, &token[8]));
+
+  for (uint8_t i = 0; i < 9; i++) {
+    SIM_CHECK(!token[i].done());
+  }
+
+  SIM_CHECK(queue.drain() == 9);
+  SIM_CHECK(queue.drain() == 0);
+
+  for (uint8_t i = 0; i < 9; i++) {
+    SIM_CHECK(token[i].done());
+  }
+
+  // 3 once before the reset (tokens 0, 1, 4), once after; key 30 rejected
+  SIM_CHECK((sim.commands.size() == 3) && (sim.commands[0] == 3) && (sim.commands[1] == FORCE_RESET) && (sim.commands[2] == 3));
+  SIM_CHECK(token[0].result && token[1].result && token[4].result && token[6].result);
+  SIM_CHECK(token[7].result == 0);
+  SIM_CHECK((token[2].result == TOUCHED_KEY + 1) && (token[3].result == TOUCHED_KEY + 1));
+  SIM_CHECK(token[8].result == 0);
+}
+
+static void testFull(void) {
+  QT1244Sim sim(QT1244_ADDR_1);
+  QT1244 dev;
+  QT1244Queue queue(&dev, 0);
+
+  simReset();
+  simAttach(&sim);
+  dev.begin(QT1244_ADDR_1);
+
+  for (uint8_t i = 0; i < QUEUE_SIZE; i++) {
+    SIM_CHECK(queue.post(QUEUE_CMD_SCAN, 0, 0));
+  }
+  SIM_CHECK(!queue.post(QUEUE_CMD_SCAN, 0, 0));
+  SIM_CHECK(queue.drain() == QUEUE_SIZE);
+  SIM_CHECK(queue.post(QUEUE_CMD_SCAN, 0, 0));
+}
+
+static std::atomic<uint32_t> posted;
+static std::atomic<uint32_t> calibrations;
+static std::atomic<uint32_t> wrong;
+static std::atomic<uint32_t> producing;
+
+/*
+	Producer n cycles through scans, calibrations of key n and of the
+	invalid key 99, each with a token from a small pool; a token is only
+	reused after its result has been checked.
+*/
+static void producer(QT1244Queue* queue, uint8_t n) {
+  QueueToken token[STRESS_TOKENS];
+  uint8_t cmd[STRESS_TOKENS];
+  uint8_t arg[STRESS_TOKENS];
+  bool used[STRESS_TOKENS] = { false };
+
+  for (uint32_t i = 0; i < STRESS_POSTS; i++) {
+    uint8_t t = i % STRESS_TOKENS;
+
+    while (!token[t].done()) {
+      std::this_thread::yield();
+    }
+
+    if (used[t]) {
+      uint8_t expect = (cmd[t] == QUEUE_CMD_SCAN) ? TOUCHED_KEY + 1 : (arg[t] <= CALIBRATE_KEY_23);
+      if (token[t].result != expect) {
+        wrong++;
+      }
+    }
+
+    switch (i % 3) {
+      case 0:  cmd[t] = QUEUE_CMD_SCAN; arg[t] = 0; break;
+      case 1:  cmd[t] = QUEUE_CMD_CALIBRATE_KEY; arg[t] = n; calibrations++; break;
+      default: cmd[t] = QUEUE_CMD_CALIBRATE_KEY; arg[t] = 99; break;
+    }
+
+    while (!queue->post(cmd[t], arg[t], &token[t])) {
+      std::this_thread::yield();
+    }
+    used[t] = true;
+    posted++;
+  }
+
+  for (uint8_t t = 0; t < STRESS_TOKENS; t++) {
+    while (!token[t].done()) {
+      std::this_thread::yield();
+    }
+    uint8_t expect = (cmd[t] == QUEUE_CMD_SCAN) ? TOUCHED_KEY + 1 : (arg[t] <= CALIBRATE_KEY_23);
+    if (token[t].result != expect) {
+      wrong++;
+    }
+  }
+
+  producing--;
+}
+
+static void testStress(void) {
+  QT1244Sim sim(QT1244_ADDR_1);
+  QT1244 dev;
+  QT1244Queue queue(&dev, 0);
+  std::vector<std::thread> threads;
+  uint32_t taken = 0, drains = 0;
+
+  simReset();
+  simAttach(&sim);
+  dev.begin(QT1244_ADDR_1);
+  sim.touch = 1UL << TOUCHED_KEY;
+  simAdvance(SIM_PERIOD_NS);
+
+  producing = STRESS_PRODUCERS;
+  for (uint8_t n = 0; n < STRESS_PRODUCERS; n++) {
+    threads.push_back(std::thread(producer, &queue, n));
+  }
+
+  // The driver thread: the only one touching dev and the simulated bus
+  for (;;) {
+    bool last = (producing == 0);
+    uint8_t n = queue.drain();
+
+    taken += n;
+    drains += (n != 0);
+    if (last && (n == 0)) {
+      break;
+    }
+    if (n == 0) {
+      std::this_thread::yield();
+    }
+  }
+
+  for (size_t i = 0; i < threads.size(); i++) {
+    threads[i].join();
+  }
+
+  printf("queue stress: %u posts, %u drains, %u calibrations posted, %u sent to the device\n",
+         (unsigned)posted.load(), drains, (unsigned)calibrations.load(), (unsigned)sim.commands.size());
+
+  SIM_CHECK(taken == STRESS_PRODUCERS * STRESS_POSTS);
+  SIM_CHECK(posted == STRESS_PRODUCERS * STRESS_POSTS);
+  SIM_CHECK(wrong == 0);
+  SIM_CHECK(sim.commands.size() <= calibrations);
+  SIM_CHECK(sim.commands.size() > 0);
+  SIM_CHECK(sim.protectedWrites == 0);
+}
+
+int main(void) {
+  testCoalescing();
+  testFull();
+  testStress();
+
+  printf("test_queue: %s\n", simFailures ? "FAILED" : "passed");
+
+  return simFailures ? 1 : 0;
+}
@@ -0,0 +1,322 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  Setups upload tests: profile switching against a device whose HCRC
+  check takes time to settle, runtime and compile-time field setting, and
+  the exact bytes an upload writes; built with QT1244_STRICT_WRITE_ENABLE,
+  against a device whose write-enable only lasts one write. Built with
+  QT1244_VERIFY, uploads corrupted on the way in and their repair.
+  Built with PROFILE_RANGE_ERROR this file must not compile.
+*******************************************************************************************************/
+#include <string.h>
+#include "qt1244.h"
+#include "qt1244_profile.h"
+#include "qt1244_sim.h"
+
+
+#define HCRC_SETTLE_NS    500000ULL
+
+// Default setups with NTHR of key 0 changed
+static void profileImage(uint8_t* image, uint8_t nthr) {
+  defaultSetups(image);
+  image[0] = (image[0] & ~NTHR_FIELD::mask) | NTHR_FIELD::put(nthr);
+  setupsCRC(image);
+}
+
+static void testSwitchSettle(void) {
+  QT1244Sim sim(QT1244_ADDR_1);
+  QT1244 dev;
+  uint8_t image[SETUPS_SIZE];
+  uint32_t transactions;
+
+  simReset();
+  simAttach(&sim);
+  sim.crcNs = HCRC_SETTLE_NS;
+  SIM_CHECK(dev.begin(QT1244_ADDR_1));
+
+  profileImage(image, 2);
+  SIM_CHECK(dev.switchProfile(image));
+  SIM_CHECK(memcmp(&sim.mem[SETUPS_ADDR], image, SETUPS_SIZE) == 0);
+
+  profileImage(image, 5);
+  transactions = simBus.transactions;
+  SIM_CHECK(dev.switchProfile(image));
+  transactions = simBus.transactions - transactions;
+  SIM_CHECK(memcmp(&sim.mem[SETUPS_ADDR], image, SETUPS_SIZE) == 0);
+  printf("switchProfile, one field: %u transactions\n", transactions);
+
+  // Unchanged profile: nothing on the bus
+  transactions = simBus.transactions;
+  SIM_CHECK(dev.switchProfile(image));
+  SIM_CHECK(simBus.transactions == transactions);
+  SIM_CHECK(sim.protectedWrites == 0);
+}
+
+static uint8_t keyField(const QT1244Sim& sim, uint8_t key) {
+  return NTHR_FIELD::get(sim.mem[NTHR_FIELD::addr + key]);
+}
+
+static void testSetAllKeys(void) {
+  QT1244Sim sim(QT1244_ADDR_1);
+  QT1244 dev;
+
+  simReset();
+  simAttach(&sim);
+  SIM_CHECK(dev.begin(QT1244_ADDR_1));
+
+  SIM_CHECK(dev.set<NTHR_FIELD>(5));
+  for (uint8_t k = 0; k < QT1244_KEYS; k++) {
+    SIM_CHECK(keyField(sim, k) == 5);
+  }
+
+  SIM_CHECK(dev.set<NTHR_FIELD>(3, 2));
+  for (uint8_t k = 0; k < QT1244_KEYS; k++) {
+    SIM_CHECK(keyField(sim, k) == ((k == 3) ? 2 : 5));
+  }
+
+  SIM_CHECK((dev.set<NTHR_FIELD, 4>()));
+  for (uint8_t k = 0; k < QT1244_KEYS; k++) {
+    SIM_CHECK(keyField(sim, k) == 4);
+  }
+
+  SIM_CHECK(!dev.set<NTHR_FIELD>(9));
+  SIM_CHECK(!dev.set<NTHR_FIELD>(QT1244_KEYS, 1));
+  SIM_CHECK(keyField(sim, 0) == 4);
+
+  sim.read(STATUS_ADDR);
+  SIM_CHECK(!(sim.mem[STATUS_ADDR] & STATUS_HCRC_ERROR));
+  SIM_CHECK(sim.protectedWrites == 0);
+}
+
+typedef struct {
+	uint8_t regAddr;
+	uint16_t len;
+} Span;
+
+// The writes since transfer from are exactly spans, in order
+static bool wrote(size_t from, const Span* spans, uint8_t count) {
+  uint8_t n = 0;
+  uint32_t bytes = 0;
+
+  for (size_t i = from; i < simBus.transfers.size(); i++) {
+    const SimTransfer* t = &simBus.transfers[i];
+
+    if (!t->write) {
+      continue;
+    }
+    if ((n == count) || (t->regAddr != spans[n].regAddr) || (t->len != spans[n].len)) {
+      return false;
+    }
+    bytes += t->len;
+    n++;
+  }
+  printf("  %u writes, %u bytes\n", n, bytes);
+
+  return n == count;
+}
+
+#if defined (QT1244_STRICT_WRITE_ENABLE)
+// One span from the write-enable through the HCRC
+static const Span ONE_FIELD[] = { { COMMAND_ADDR, HCRCmsb_ADDR - COMMAND_ADDR + 1 }, { COMMAND_ADDR, 1 } };
+static const Span THREE_FIELDS[] = { { COMMAND_ADDR, HCRCmsb_ADDR - COMMAND_ADDR + 1 }, { COMMAND_ADDR, 1 } };
+static const Span SWITCH[] = { { COMMAND_ADDR, HCRCmsb_ADDR - COMMAND_ADDR + 1 } };
+#else
+// Write-enable attached to a nearby first run, then the runs and the HCRC
+static const Span ONE_FIELD[] = { { COMMAND_ADDR, 7 }, { HCRClsb_ADDR, 2 }, { COMMAND_ADDR, 1 } };
+static const Span THREE_FIELDS[] = { { COMMAND_ADDR, 2 }, { NTHR_PTHR_NDRIFT_BL_ADDR + 23, 1 }, { DWELL_RIB_THRM_FHM_ADDR, 1 },
+                                     { HCRClsb_ADDR, 2 }, { COMMAND_ADDR, 1 } };
+static const Span SWITCH[] = { { COMMAND_ADDR, 2 }, { DWELL_RIB_THRM_FHM_ADDR, 1 }, { HCRClsb_ADDR, 2 } };
+#endif
+
+/*
+	Exactly the changed bytes and the HCRC are written, the write-enable
+	first, and no setups byte lands while the device is write protected.
+	With QT1244_STRICT_WRITE_ENABLE the device drops the write-enable at
+	the end of every write, and every upload is one span.
+*/
+static void testTransactions(void) {
+  QT1244Sim sim(QT1244_ADDR_1);
+  QT1244 dev;
+  uint8_t image[SETUPS_SIZE];
+  size_t from;
+
+  simReset();
+  simAttach(&sim);
+#if defined (QT1244_STRICT_WRITE_ENABLE)
+  sim.strict = true;
+#endif
+  simBus.log = true;
+  SIM_CHECK(dev.begin(QT1244_ADDR_1));
+
+  // No batch open: nothing is sent
+  from = simBus.transfers.size();
+  dev.batchCommand(CALIBRATE_KEY_ALL);
+  SIM_CHECK(!dev.batchCommit());
+  SIM_CHECK(simBus.transfers.size() == from);
+
+  SIM_CHECK(dev.set<NTHR_FIELD>(4));
+
+  printf("one field and a calibration:\n");
+  from = simBus.transfers.size();
+  dev.batchBegin();
+  SIM_CHECK(dev.set<NTHR_FIELD>(5, 2));
+  dev.batchCommand(CALIBRATE_KEY_5);
+  SIM_CHECK(dev.batchCommit());
+  SIM_CHECK(wrote(from, ONE_FIELD, sizeof(ONE_FIELD) / sizeof(Span)));
+  SIM_CHECK(keyField(sim, 5) == 2);
+
+  printf("three fields and a calibration:\n");
+  from = simBus.transfers.size();
+  dev.batchBegin();
+  SIM_CHECK(dev.set<NTHR_FIELD>(0, 1));
+  SIM_CHECK(dev.set<NTHR_FIELD>(23, 3));
+  SIM_CHECK(dev.set<DWELL_FIELD>(5));
+  dev.batchCommand(CALIBRATE_KEY_ALL);
+  SIM_CHECK(dev.batchCommit());
+  SIM_CHECK(wrote(from, THREE_FIELDS, sizeof(THREE_FIELDS) / sizeof(Span)));
+  SIM_CHECK((keyField(sim, 0) == 1) && (keyField(sim, 23) == 3));
+  SIM_CHECK(DWELL_FIELD::get(sim.mem[DWELL_FIELD::addr]) == 5);
+
+  printf("switchProfile, two fields:\n");
+  memcpy(image, &sim.mem[SETUPS_ADDR], SETUPS_SIZE);
+  image[0] = (image[0] & ~NTHR_FIELD::mask) | NTHR_FIELD::put(6);
+  image[DWELL_FIELD::addr - SETUPS_ADDR] = (image[DWELL_FIELD::addr - SETUPS_ADDR] & ~DWELL_FIELD::mask) | DWELL_FIELD::put(2);
+  setupsCRC(image);
+  from = simBus.transfers.size();
+  SIM_CHECK(dev.switchProfile(image));
+  SIM_CHECK(wrote(from, SWITCH, sizeof(SWITCH) / sizeof(Span)));
+  SIM_CHECK(memcmp(&sim.mem[SETUPS_ADDR], image, SETUPS_SIZE) == 0);
+
+  simAdvance(2 * SIM_PERIOD_NS);
+  sim.read(STATUS_ADDR);
+  SIM_CHECK(!(sim.mem[STATUS_ADDR] & STATUS_HCRC_ERROR));
+  SIM_CHECK(sim.protectedWrites == 0);
+  SIM_CHECK((sim.commands.size() == 2) && (sim.commands[0] == CALIBRATE_KEY_5) && (sim.commands[1] == CALIBRATE_KEY_ALL));
+  simBus.log = false;
+}
+
+#if defined (QT1244_VERIFY)
+
+static uint32_t readbacks(size_t from) {
+  uint32_t n = 0;
+
+  for (size_t i = from; i < simBus.transfers.size(); i++) {
+    const SimTransfer* t = &simBus.transfers[i];
+
+    n += !t->write && (t->regAddr == SETUPS_ADDR) && (t->len == SETUPS_SIZE);
+  }
+
+  return n;
+}
+
+// Whole block, then the corrupted bytes
+static const Span REPAIR_HEAD[] = { { COMMAND_ADDR, HCRCmsb_ADDR - COMMAND_ADDR + 1 }, { COMMAND_ADDR, 4 } };
+#if defined (QT1244_STRICT_WRITE_ENABLE)
+static const Span REPAIR_MIDDLE[] = { { COMMAND_ADDR, HCRCmsb_ADDR - COMMAND_ADDR + 1 }, { COMMAND_ADDR, 104 } };
+#else
+static const Span REPAIR_MIDDLE[] = { { COMMAND_ADDR, HCRCmsb_ADDR - COMMAND_ADDR + 1 }, { COMMAND_ADDR, 1 }, { SETUPS_ADDR + 100, 3 } };
+#endif
+
+/*
+	Uploads corrupted on the way in: one read-back, then only the corrupted
+	bytes are rewritten. A device that keeps corrupting them fails after
+	VERIFY_RETRIES repairs, and an image with a wrong HCRC of its own fails
+	after one read-back, with nothing rewritten.
+*/
+static void testRepair(void) {
+  QT1244Sim sim(QT1244_ADDR_1);
+  QT1244 dev;
+  uint8_t image[SETUPS_SIZE];
+  size_t from;
+
+  simReset();
+  simAttach(&sim);
+#if defined (QT1244_STRICT_WRITE_ENABLE)
+  sim.strict = true;
+#endif
+  simBus.log = true;
+  SIM_CHECK(dev.begin(QT1244_ADDR_1));
+  profileImage(image, 3);
+
+  printf("repair, first 3 bytes corrupted:\n");
+  sim.corrupt = 3;
+  from = simBus.transfers.size();
+  SIM_CHECK(dev.setups(image));
+  SIM_CHECK(readbacks(from) == 1);
+  SIM_CHECK(wrote(from, REPAIR_HEAD, sizeof(REPAIR_HEAD) / sizeof(Span)));
+  SIM_CHECK(memcmp(&sim.mem[SETUPS_ADDR], image, SETUPS_SIZE) == 0);
+
+  printf("repair, 3 bytes from offset 100 corrupted:\n");
+  sim.corruptSkip = 100;
+  sim.corrupt = 3;
+  from = simBus.transfers.size();
+  SIM_CHECK(dev.setups(image));
+  SIM_CHECK(readbacks(from) == 1);
+  SIM_CHECK(wrote(from, REPAIR_MIDDLE, sizeof(REPAIR_MIDDLE) / sizeof(Span)));
+  SIM_CHECK(memcmp(&sim.mem[SETUPS_ADDR], image, SETUPS_SIZE) == 0);
+
+  // Every byte corrupted, for good
+  sim.corrupt = 0xFFFFFFFF;
+  from = simBus.transfers.size();
+  SIM_CHECK(!dev.setups(image));
+  SIM_CHECK(readbacks(from) == VERIFY_RETRIES);
+  sim.corrupt = 0;
+
+  // The image's own HCRC is wrong: the read-back matches, nothing to repair
+  image[NRD_ADDR - SETUPS_ADDR] ^= 1;
+  from = simBus.transfers.size();
+  SIM_CHECK(!dev.setups(image));
+  SIM_CHECK(readbacks(from) == 1);
+  SIM_CHECK(wrote(from, REPAIR_HEAD, 1));
+
+  SIM_CHECK(sim.protectedWrites == 0);
+  simBus.log = false;
+}
+
+#endif
+
+static constexpr QT1244Profile GLOVE = qt1244Profile("glove", qt1244Params().withNTHR(1).withBL(3));
+
+#if defined (PROFILE_RANGE_ERROR)
+static constexpr QT1244Profile WRONG = qt1244Profile("wrong", qt1244Params().withNTHR(9));
+#endif
+
+static void testProfile(void) {
+  uint8_t image[SETUPS_SIZE];
+
+  defaultSetups(image);
+  image[0] = (image[0] & ~(NTHR_FIELD::mask | BL_FIELD::mask)) | NTHR_FIELD::put(1) | BL_FIELD::put(3);
+  for (uint8_t k = 1; k < QT1244_KEYS; k++) {
+    image[k] = image[0];
+  }
+  setupsCRC(image);
+
+  SIM_CHECK(memcmp(GLOVE.image, image, SETUPS_SIZE) == 0);
+}
+
+int main(void) {
+  testSwitchSettle();
+  testSetAllKeys();
+  testTransactions();
+#if defined (QT1244_VERIFY)
+  testRepair();
+#endif
+  testProfile();
+
+  printf("test_setups: %s\n", simFailures ? "FAILED" : "passed");
+
+  return simFailures ? 1 : 0;
+}
@@ -0,0 +1,182 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  QT1244Stats tests: press, idle, coalesced and chord counts, the edges of
+  the hold-time and latency bins, percentiles, calibration failures, and
+  read() against a std::thread updating the counters: every copy it
+  returns is consistent, and it returns instead of waiting for the writer.
+*******************************************************************************************************/
+#include <atomic>
+#include <string.h>
+#include <thread>
+#include "qt1244_stats.h"
+#include "qt1244_sim.h"
+
+
+static void testCounts(void) {
+  QT1244Stats stats;
+  QT1244StatsData d;
+
+  stats.edges(0x000001, 100);		// Key 0 down
+  stats.edges(0x000001, 110);		// Idle
+  stats.edges(0x000103, 120);		// Keys 1 and 8 down: coalesced, chord
+  stats.edges(0x000000, 200);		// All up: coalesced
+  stats.edges(0x000001, 300);
+
+  SIM_CHECK(stats.read(&d));
+  SIM_CHECK((d.press[0] == 2) && (d.press[1] == 1) && (d.press[8] == 1) && (d.press[2] == 0));
+  SIM_CHECK((d.reads == 5) && (d.idle == 1) && (d.coalesced == 2) && (d.chords == 1));
+  SIM_CHECK((d.firstMs == 100) && (d.lastMs == 300));
+
+  stats.calibration(1UL << 3);
+  stats.calibration(1UL << 3);			// Still failing: counted once
+  stats.calibration(0);
+  stats.calibration((1UL << 3) | (1UL << 23));
+  SIM_CHECK(stats.read(&d));
+  SIM_CHECK((d.calFail[3] == 2) && (d.calFail[23] == 1) && (d.calFail[0] == 0));
+
+  stats.reset();
+  SIM_CHECK(stats.read(&d));
+  SIM_CHECK((d.reads == 0) && (d.press[0] == 0) && (d.calFail[3] == 0));
+}
+
+// Hold of ms on key 5: bin it landed in
+static int8_t holdBin(uint32_t ms) {
+  QT1244Stats stats;
+  QT1244StatsData d;
+
+  stats.edges(1UL << 5, 1000);
+  stats.edges(0, 1000 + ms);
+  stats.read(&d);
+
+  for (uint8_t b = 0; b < STATS_HOLD_BINS; b++) {
+    if (d.hold[b][5]) {
+      return b;
+    }
+  }
+
+  return -1;
+}
+
+static int8_t latencyBin(uint32_t us) {
+  QT1244Stats stats;
+  QT1244StatsData d;
+
+  stats.latency(us);
+  stats.read(&d);
+
+  for (uint8_t b = 0; b < STATS_LATENCY_BINS; b++) {
+    if (d.latency[b]) {
+      return b;
+    }
+  }
+
+  return -1;
+}
+
+static void testBins(void) {
+  QT1244Stats stats;
+  QT1244StatsData d;
+
+  // Bin 0 below the base, bin b from base << (b - 1) up to base << b
+  SIM_CHECK(holdBin(0) == 0);
+  SIM_CHECK(holdBin(STATS_HOLD_BASE_MS - 1) == 0);
+  SIM_CHECK(holdBin(STATS_HOLD_BASE_MS) == 1);
+  SIM_CHECK(holdBin(2 * STATS_HOLD_BASE_MS - 1) == 1);
+  SIM_CHECK(holdBin(2 * STATS_HOLD_BASE_MS) == 2);
+  SIM_CHECK(holdBin(STATS_HOLD_BASE_MS << (STATS_HOLD_BINS - 2)) == STATS_HOLD_BINS - 1);
+  SIM_CHECK(holdBin(600000) == STATS_HOLD_BINS - 1);
+
+  SIM_CHECK(latencyBin(STATS_LATENCY_BASE_US - 1) == 0);
+  SIM_CHECK(latencyBin(STATS_LATENCY_BASE_US) == 1);
+  SIM_CHECK(latencyBin(4 * STATS_LATENCY_BASE_US - 1) == 2);
+  SIM_CHECK(latencyBin(4 * STATS_LATENCY_BASE_US) == 3);
+  SIM_CHECK(latencyBin(0xFFFFFFFF) == STATS_LATENCY_BINS - 1);
+
+  // 90 fast reads and 10 slow ones
+  for (uint8_t i = 0; i < 90; i++) {
+    stats.latency(STATS_LATENCY_BASE_US / 2);
+  }
+  for (uint8_t i = 0; i < 10; i++) {
+    stats.latency(3 * STATS_LATENCY_BASE_US);
+  }
+  SIM_CHECK(stats.read(&d));
+  SIM_CHECK(statsPercentile(&d, 50) == STATS_LATENCY_BASE_US);
+  SIM_CHECK(statsPercentile(&d, 90) == STATS_LATENCY_BASE_US);
+  SIM_CHECK(statsPercentile(&d, 91) == 4 * STATS_LATENCY_BASE_US);
+  SIM_CHECK(statsPercentile(&d, 100) == 4 * STATS_LATENCY_BASE_US);
+
+  stats.latency(0xFFFFFFFF);
+  SIM_CHECK(stats.read(&d));
+  SIM_CHECK(statsPercentile(&d, 100) == 0xFFFFFFFF);
+
+  stats.reset();
+  SIM_CHECK(stats.read(&d));
+  SIM_CHECK(statsPercentile(&d, 50) == 0);
+}
+
+/*
+	A writer thread toggling key 0, so every consistent copy has reads equal
+	to presses plus releases (modulo the 16-bit hold counters) and idle
+	equal to 0.
+*/
+static void testConcurrent(void) {
+  QT1244Stats stats;
+  std::atomic<bool> stop(false);
+  uint32_t copies = 0, refused = 0, torn = 0;
+
+  std::thread writer([&]() {
+    uint32_t now = 1;
+
+    while (!stop) {
+      stats.edges(now & 1, now);
+      now++;
+    }
+  });
+
+  for (uint32_t i = 0; i < 200000; i++) {
+    QT1244StatsData d;
+    uint16_t holds = 0;
+
+    if (!stats.read(&d)) {
+      refused++;
+      std::this_thread::yield();
+      continue;
+    }
+    copies++;
+    for (uint8_t b = 0; b < STATS_HOLD_BINS; b++) {
+      holds += d.hold[b][0];
+    }
+    torn += ((uint16_t)(d.reads - d.press[0]) != holds) || (d.idle != 0);
+  }
+
+  stop = true;
+  writer.join();
+
+  printf("concurrent: %u copies, %u refused, %u torn\n", copies, refused, torn);
+  SIM_CHECK(copies > 0);
+  SIM_CHECK(torn == 0);
+}
+
+int main(void) {
+  testCounts();
+  testBins();
+  testConcurrent();
+
+  printf("test_stats: %s\n", simFailures ? "FAILED" : "passed");
+
+  return simFailures ? 1 : 0;
+}
@@ -0,0 +1,137 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  Self-healing supervisor tests (QT1244_SUPERVISOR) against a simulated
+  device with keys failing calibration: a transient failure healed by one
+  recalibration, and a key failing for longer than every escalation that
+  keeps being retried at the budgeted rate and recovers once its fault
+  clears.
+*******************************************************************************************************/
+#include <vector>
+#include "qt1244.h"
+#include "qt1244_sim.h"
+
+
+#define SUPERVISE_MS      100
+#define STUCK_KEY         4
+#define TRANSIENT_KEY     7
+
+typedef struct {
+	uint32_t ms;
+	uint8_t command;
+} Sent;
+
+static uint32_t nowMs(void) {
+  return (uint32_t)(simBus.now / 1000000);
+}
+
+/*
+	Call supervise() every SUPERVISE_MS until ms, logging the commands sent;
+	returns the last result.
+*/
+static uint32_t superviseUntil(QT1244* dev, QT1244Sim* sim, uint32_t ms, std::vector<Sent>* sent) {
+  uint32_t failing = 0;
+
+  while (nowMs() < ms) {
+    size_t before = sim->commands.size();
+
+    failing = dev->supervise(nowMs());
+    for (size_t i = before; i < sim->commands.size(); i++) {
+      Sent s = { nowMs(), sim->commands[i] };
+      sent->push_back(s);
+    }
+    simAdvance(SUPERVISE_MS * 1000000ULL);
+  }
+
+  return failing;
+}
+
+static void testTransient(void) {
+  QT1244Sim sim(QT1244_ADDR_1);
+  QT1244 dev;
+  std::vector<Sent> sent;
+
+  simReset();
+  simAttach(&sim);
+  SIM_CHECK(dev.begin(QT1244_ADDR_1));
+
+  sim.calFail = 1UL << TRANSIENT_KEY;
+  dev.calibrateKey(TRANSIENT_KEY);
+  simAdvance(200000000ULL);
+  sim.calFail = 0;
+
+  SIM_CHECK(superviseUntil(&dev, &sim, nowMs() + 2000, &sent) == 0);
+  SIM_CHECK((sent.size() == 1) && (sent[0].command == TRANSIENT_KEY));
+}
+
+static void testStuck(void) {
+  QT1244Sim sim(QT1244_ADDR_1);
+  QT1244 dev;
+  std::vector<Sent> sent;
+  uint32_t start, cleared, last = 0, late = 0, worst = 0;
+
+  simReset();
+  simAttach(&sim);
+  SIM_CHECK(dev.begin(QT1244_ADDR_1));
+
+  sim.calFail = 1UL << STUCK_KEY;
+  dev.calibrateKey(STUCK_KEY);
+  simAdvance(200000000ULL);
+  start = nowMs();
+
+  SIM_CHECK(superviseUntil(&dev, &sim, start + 3 * SUPERVISOR_WINDOW_MS, &sent) == (1UL << STUCK_KEY));
+
+  // Both escalations, once each, early on
+  SIM_CHECK((sent.size() > 8) && (sent[3].command == CALIBRATE_KEY_ALL) && (sent[7].command == FORCE_RESET));
+
+  // Still retried after the escalations ran out, never above the budget
+  for (size_t i = 0; i < sent.size(); i++) {
+    uint32_t window = 0;
+
+    for (size_t j = i; (j < sent.size()) && (sent[j].ms - sent[i].ms < SUPERVISOR_WINDOW_MS); j++) {
+      window++;
+    }
+    if (window > worst) {
+      worst = window;
+    }
+    late += (sent[i].ms >= start + 2 * SUPERVISOR_WINDOW_MS);
+  }
+  printf("stuck key: %u commands in %u s, at most %u in a window, %u in the last window\n",
+         (unsigned)sent.size(), 3 * SUPERVISOR_WINDOW_MS / 1000, worst, late);
+  SIM_CHECK(late > 0);
+  SIM_CHECK(worst <= 3 * (SUPERVISOR_RETRIES + 1));
+
+  // The fault clears: healed without operator action
+  sim.calFail = 0;
+  cleared = nowMs();
+  sent.clear();
+  SIM_CHECK(superviseUntil(&dev, &sim, cleared + 2 * SUPERVISOR_WINDOW_MS, &sent) == 0);
+  for (size_t i = 0; i < sent.size(); i++) {
+    last = sent[i].ms;
+  }
+  printf("stuck key: healed %u ms after the fault cleared\n", last - cleared);
+  SIM_CHECK(!sent.empty() && (last - cleared <= SUPERVISOR_WINDOW_MS + 1000));
+  SIM_CHECK(sim.protectedWrites == 0);
+}
+
+int main(void) {
+  testTransient();
+  testStuck();
+
+  printf("test_supervisor: %s\n", simFailures ? "FAILED" : "passed");
+
+  return simFailures ? 1 : 0;
+}
@@ -0,0 +1,159 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  Acquisition-cycle sync tests (QT1244_SYNC): the cycle model, learning
+  only from adjacent-cycle edge intervals, and cycleRead() against a
+  simulated device whose CHANGE edges drive cycleEdge().
+*******************************************************************************************************/
+#include <string.h>
+#include "qt1244.h"
+#include "qt1244_sim.h"
+
+
+#define STEP_US     100
+
+static uint32_t nowUs(void) {
+  return (uint32_t)(simBus.now / 1000);
+}
+
+static void testModel(void) {
+  uint8_t image[SETUPS_SIZE];
+  uint32_t base;
+
+  defaultSetups(image);
+  base = cycleModel(image);
+  printf("model: %u us at the defaults\n", base);
+  SIM_CHECK((base > 8000) && (base < 30000));
+
+  // Longer bursts, longer cycle
+  for (uint8_t k = 0; k < QT1244_KEYS; k++) {
+    image[k] = (image[k] & ~BL_FIELD::mask) | BL_FIELD::put(3);
+  }
+  SIM_CHECK(cycleModel(image) > base);
+
+  defaultSetups(image);
+  image[DWELL_RIB_THRM_FHM_ADDR - SETUPS_ADDR] |= DWELL_FIELD::put(7);
+  SIM_CHECK(cycleModel(image) > base);
+
+  // Mains sync rounds up to whole mains periods
+  defaultSetups(image);
+  image[SLEEP_MSYNC_NHYST_DEBUG_ADDR - SETUPS_ADDR] |= MSYNC_FIELD::put(1);
+  SIM_CHECK(cycleModel(image) % SYNC_MAINS_US == 0);
+  SIM_CHECK(cycleModel(image) >= base);
+}
+
+/*
+	Edges every 1, 2, 3 or 5 cycles of a device running 4% slower than the
+	model, plus glitches: the estimate must settle on the real period, not
+	on the model nor a multiple.
+*/
+static void testLearning(void) {
+  static const uint8_t gaps[] = { 1, 2, 1, 3, 1, 1, 5, 2, 1 };
+  uint8_t image[SETUPS_SIZE];
+  QT1244 dev;
+  uint32_t model, real, now = 1000;
+
+  defaultSetups(image);
+  model = cycleModel(image);
+  real = model * 104 / 100;
+  SIM_CHECK(dev.cyclePeriod() == model);
+
+  for (uint16_t i = 0; i < 400; i++) {
+    now += gaps[i % sizeof(gaps)] * real;
+    dev.cycleEdge(now);
+    if (i % 7 == 0) {
+      dev.cycleEdge(now + 150);		// Glitch
+      now += 150;
+    }
+  }
+
+  printf("learnt: %u us, real %u us, model %u us\n", dev.cyclePeriod(), real, model);
+  SIM_CHECK(dev.cyclePeriod() + real / 100 >= real);
+  SIM_CHECK(dev.cyclePeriod() <= real + real / 100);
+}
+
+/*
+	cycleRead() polled every STEP_US: about one read per cycle, and every
+	touch seen within a cycle of its detection.
+*/
+static void testRead(void) {
+  QT1244Sim sim(QT1244_ADDR_1);
+  QT1244 dev;
+  uint32_t keys = 0, seen = 0, transactions, cycles;
+  uint64_t changed = 0, worst = 0;
+  bool change = false;
+
+  simReset();
+  simAttach(&sim);
+  SIM_CHECK(dev.begin(QT1244_ADDR_1));
+  SIM_CHECK(dev.cyclePeriod() == cycleModel(&sim.mem[SETUPS_ADDR]));
+
+  transactions = simBus.transactions;
+  cycles = sim.cycles;
+
+  for (uint32_t step = 0; step < 20000; step++) {
+    uint32_t detect = sim.detect();
+
+    // Touch toggles every 5th cycle boundary
+    if ((step % 800) == 0) {
+      sim.touch ^= 1UL << 4;
+    }
+
+    simAdvance(STEP_US * 1000);
+
+    if (sim.detect() != detect) {
+      changed = simBus.now;
+    }
+    if (sim.change && !change) {
+      dev.cycleEdge(nowUs());
+    }
+    change = sim.change;
+
+    if (dev.cycleRead(nowUs(), &keys)) {
+      change = sim.change;
+      if (keys != seen) {
+        if (simBus.now - changed > worst) {
+          worst = simBus.now - changed;
+        }
+        seen = keys;
+      }
+    }
+  }
+
+  transactions = simBus.transactions - transactions;
+  cycles = sim.cycles - cycles;
+  printf("cycleRead: %u reads over %u cycles, worst detect-to-read %llu us\n",
+         transactions, cycles, (unsigned long long)(worst / 1000));
+
+  SIM_CHECK(transactions <= cycles + cycles / 10);
+  SIM_CHECK(transactions >= cycles / 2);
+  SIM_CHECK(worst / 1000 <= SYNC_GUARD_US + 2 * STEP_US + 100);
+
+  // A setups upload restarts the estimate from the new model
+  SIM_CHECK(dev.set<MSYNC_FIELD>(1));
+  SIM_CHECK(dev.cyclePeriod() == cycleModel(&sim.mem[SETUPS_ADDR]));
+  SIM_CHECK(dev.cyclePeriod() % SYNC_MAINS_US == 0);
+}
+
+int main(void) {
+  testModel();
+  testLearning();
+  testRead();
+
+  printf("test_sync: %s\n", simFailures ? "FAILED" : "passed");
+
+  return simFailures ? 1 : 0;
+}
@@ -0,0 +1,156 @@
+/*******************************************************************************************************
+  Version 1.0
+
+  Author by: Muhammad Hafiz Bin Mastro
+  Title: Firmware Engineer
+  Company:
+    ParkAide Mobile (M) Sdn. Bhd.
+    Unit D-9-13A, Block D, Oasis Square,
+    Jalan PJU 1A/7A, Ara Damansara,
+    47301 Petaling Jaya,
+    Selangor Darul Ehsan,
+    Malaysia.
+    Mobile: +60 17-341 1270
+    Telephone: +60 3-7859 6198
+    Fax: +60 3-7859 9198
+
+  Tuner tests: touch and noise deltas are driven straight into the
+  simulated key data, with outliers the tuner must discard and a key that
+  never shows noise, and the BL, NDIL and NTHR chosen per key are checked
+  against values worked out by hand from QT1244_BL_PULSES and
+  QT1244_NTHR_COUNTS. The device then takes the image without an HCRC
+  error.
+*******************************************************************************************************/
+#include <string.h>
+#include "qt1244.h"
+#include "qt1244_sim.h"
+
+
+#define TUNE_SNR          8
+#define ALL_KEYS          0xFFFFFF
+
+static int16_t delta[QT1244_KEYS];			// Reference - signal per key
+
+static void drive(QT1244Sim* dev) {
+  for (uint8_t k = 0; k < QT1244_KEYS; k++) {
+    uint16_t signal = SIM_REFERENCE - delta[k];
+
+    dev->mem[KEY_DATA_ADDR + k * KEY_DATA_SIZE + KEY_DATA_SIGNAL] = signal & 0xFF;
+    dev->mem[KEY_DATA_ADDR + k * KEY_DATA_SIZE + KEY_DATA_SIGNAL + 1] = signal >> 8;
+  }
+}
+
+/*
+	Key 0: touch 39 once the outliers 5 and 6 are gone, noise 3 once the
+	spikes 30 and 25 are gone. Key 1: touch 6, no noise at all. Other keys:
+	touch 20, noise 4. A key held during a noise round reads as a touch no
+	smaller than its own.
+*/
+static const int16_t key0Touch[6] = { 40, 41, 5, 42, 6, 39 };
+static const int16_t key0Noise[5] = { 2, -30, 3, 25, -2 };
+static const int16_t restNoise[5] = { 4, -4, 3, -2, 4 };
+
+static void sampleTouch(QT1244& dev, QT1244Sim& sim) {
+  for (uint8_t r = 0; r < 6; r++) {
+    for (uint8_t k = 0; k < QT1244_KEYS; k++) {
+      delta[k] = (k == 0) ? key0Touch[r] : (k == 1) ? 6 : 20;
+    }
+    drive(&sim);
+    dev.tuneSample(ALL_KEYS);
+  }
+}
+
+// Noise rounds from - to - 1 on the quiet keys, the others held
+static void sampleNoise(QT1244& dev, QT1244Sim& sim, uint32_t quiet, uint8_t from, uint8_t to) {
+  for (uint8_t r = from; r < to; r++) {
+    for (uint8_t k = 0; k < QT1244_KEYS; k++) {
+      if (quiet & (1UL << k)) {
+        delta[k] = (k == 0) ? key0Noise[r] : (k == 1) ? 0 : restNoise[r];
+      }
+      else {
+        delta[k] = (k == 0) ? 42 : (k == 1) ? 6 : 20;
+      }
+    }
+    drive(&sim);
+    dev.tuneSample(ALL_KEYS & ~quiet);
+  }
+}
+
+static bool keyIs(const uint8_t* image, uint8_t key, uint8_t bl, uint8_t ndil, uint8_t nthr) {
+  uint8_t a = image[NTHR_PTHR_NDRIFT_BL_ADDR - SETUPS_ADDR + key];
+  uint8_t b = image[NDIL_FDIL_AKS_WAKE_ADDR - SETUPS_ADDR + key];
+
+  return (BL_FIELD::get(a) == bl) && (NTHR_FIELD::get(a) == nthr) && (NDIL_FIELD::get(b) == ndil) &&
+         (NDRIFT_FIELD::get(a) == NDRIFT_VALUE) && (FDIL_FIELD::get(b) == FDIL_VALUE);
+}
+
+// Everything outside the per-key NTHR/BL and NDIL bytes and the HCRC is the defaults
+static bool restDefault(const uint8_t* image) {
+  uint8_t defaults[SETUPS_SIZE];
+
+  defaultSetups(defaults);
+  for (uint8_t i = 0; i < SETUPS_SIZE - 2; i++) {
+    bool perKey = ((i >= NTHR_PTHR_NDRIFT_BL_ADDR - SETUPS_ADDR) && (i < NTHR_PTHR_NDRIFT_BL_ADDR - SETUPS_ADDR + QT1244_KEYS)) ||
+                  ((i >= NDIL_FDIL_AKS_WAKE_ADDR - SETUPS_ADDR) && (i < NDIL_FDIL_AKS_WAKE_ADDR - SETUPS_ADDR + QT1244_KEYS));
+
+    if (!perKey && (image[i] != defaults[i])) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static void testSolve(void) {
+  QT1244Sim sim(QT1244_ADDR_1);
+  QT1244 dev;
+  uint8_t image[SETUPS_SIZE];
+
+  simReset();
+  simAttach(&sim);
+  simBus.cycled = drive;
+  SIM_CHECK(dev.begin(QT1244_ADDR_1));
+
+  dev.tuneBegin();
+  SIM_CHECK(!dev.tuneSolve(TUNE_SNR, image));
+
+  sampleTouch(dev, sim);
+  sampleNoise(dev, sim, ALL_KEYS, 0, 2);
+  sampleNoise(dev, sim, ALL_KEYS & ~(1UL << 2), 2, 5);
+
+  // Key 2 has only two noise samples, no more than are discarded: defaults, and false
+  SIM_CHECK(!dev.tuneSolve(TUNE_SNR, image));
+  SIM_CHECK(keyIs(image, 2, BL_VALUE, NDIL_VALUE, NTHR_PTHR_VALUE));
+
+  // Touch 39 and noise 3 need no integration at 16 pulses; NTHR 20 is nearest to 21
+  SIM_CHECK(keyIs(image, 0, 0, 1, 5));
+
+  // No noise counts as 1 at 16 pulses, 2 at 32 and 3 at 48: only 32 pulses and NDIL 2 meet 8
+  SIM_CHECK(keyIs(image, 1, 2, 2, 0));
+
+  // Touch 20, noise 4: 20 x 20 x NDIL >= 8 x 8 x 4 x 4 first holds for NDIL 3
+  for (uint8_t k = 3; k < QT1244_KEYS; k++) {
+    SIM_CHECK(keyIs(image, k, 0, 3, 3));
+  }
+
+  sampleNoise(dev, sim, 1UL << 2, 0, 5);
+  SIM_CHECK(dev.tuneSolve(TUNE_SNR, image));
+  SIM_CHECK(keyIs(image, 0, 0, 1, 5));
+  SIM_CHECK(keyIs(image, 1, 2, 2, 0));
+  SIM_CHECK(keyIs(image, 2, 0, 3, 3));
+  SIM_CHECK(restDefault(image));
+
+  SIM_CHECK(dev.setups(image));
+  SIM_CHECK(memcmp(&sim.mem[SETUPS_ADDR], image, SETUPS_SIZE) == 0);
+  sim.read(STATUS_ADDR);
+  SIM_CHECK(!(sim.mem[STATUS_ADDR] & STATUS_HCRC_ERROR));
+  SIM_CHECK(sim.protectedWrites == 0);
+}
+
+int main(void) {
+  testSolve();
+
+  printf("test_tuner: %s\n", simFailures ? "FAILED" : "passed");
+
+  return simFailures ? 1 : 0;
+}